@@ -0,0 +1,216 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   bundle.c
+ * Created on October 17, 2026, 10:12 AM
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bundle.h"
+#include "logger.h"
+
+static const unsigned char* map = NULL;                 /* The mapped bundle */
+static size_t map_size = 0;                             /* Size of the mapping */
+static const struct bundle_record* records = NULL;      /* The sorted index */
+static uint32_t record_count = 0;                       /* Number of index records */
+
+/**
+ * Compare a path with the path of an index record. 
+ * @param path the path to compare. 
+ * @param len the length of the path. 
+ * @param rec the index record. 
+ * @return <0, 0 or >0 like strcmp. 
+ */
+static int _bundle_compare(const char* path, size_t len, const struct bundle_record* rec)
+{
+    size_t rlen = le32toh(rec->path_length);
+    int c = memcmp(path, map + le32toh(rec->path_offset), len < rlen ? len : rlen);
+    
+    if(c != 0) {
+        return c;
+    }
+    
+    return len < rlen ? -1 : (len > rlen ? 1 : 0);
+}
+
+/**
+ * Map a bundle in memory and check its index. 
+ * @param path the bundle file. 
+ * @return true on success. 
+ */
+bool bundle_open(const char* path)
+{
+    const struct bundle_header* hdr;
+    const struct bundle_record* rec;
+    struct stat st;
+    uint32_t i, k;
+    void* m;
+    int fd;
+    
+    if((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+        log_message(LOG_ERROR, "Could not open bundle %s: %s\r\n", path, strerror(errno));
+        return false;
+    }
+    
+    if(fstat(fd, &st) || (size_t) st.st_size < sizeof(struct bundle_header)) {
+        log_message(LOG_ERROR, "Bundle %s is to small\r\n", path);
+        close(fd);
+        return false;
+    }
+    
+    m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(m == MAP_FAILED) {
+        log_message(LOG_ERROR, "Could not map bundle %s: %s\r\n", path, strerror(errno));
+        return false;
+    }
+    
+    map = m;
+    map_size = st.st_size;
+    hdr = (const struct bundle_header*) map;
+    record_count = le32toh(hdr->count);
+    
+    /* Validate everything once so lookups can trust the index */
+    if(memcmp(hdr->magic, BUNDLE_MAGIC, sizeof(hdr->magic)) || 
+       le32toh(hdr->index_offset) % 8 || le32toh(hdr->index_offset) > map_size ||
+       record_count > (map_size - le32toh(hdr->index_offset)) / sizeof(struct bundle_record)) {
+        goto invalid;
+    }
+    
+    records = (const struct bundle_record*) (map + le32toh(hdr->index_offset));
+    for(i = 0; i < record_count; ++i) {
+        rec = &records[i];
+        if((uint64_t) le32toh(rec->path_offset) + le32toh(rec->path_length) > map_size) {
+            goto invalid;
+        }
+        for(k = 0; k < BUNDLE_BLOB_COUNT; ++k) {
+            if((uint64_t) le32toh(rec->blobs[k].offset) + le32toh(rec->blobs[k].size) > map_size || 
+               memchr(rec->blobs[k].etag, '\0', BUNDLE_ETAG_LEN) == NULL) {
+                goto invalid;
+            }
+        }
+    }
+    
+    log_message(LOG_INFO, "Serving %d files from bundle %s\r\n", (int) record_count, path);
+    return true;
+    
+invalid:
+    log_message(LOG_ERROR, "Bundle %s is corrupt\r\n", path);
+    bundle_close();
+    return false;
+}
+
+/**
+ * Unmap the bundle. 
+ */
+void bundle_close()
+{
+    if(map != NULL) {
+        munmap((void*) map, map_size);
+    }
+    
+    map = NULL;
+    map_size = 0;
+    records = NULL;
+    record_count = 0;
+}
+
+/**
+ * Check if files are served from a bundle. 
+ * @return true when a bundle is open. 
+ */
+bool bundle_enabled()
+{
+    return map != NULL;
+}
+
+/**
+ * Find a file in the bundle. 
+ * @param path the path relative to the HTML root, starting with '/'. 
+ * @return the index record or NULL when not in the bundle. 
+ */
+const struct bundle_record* bundle_find(const char* path)
+{
+    size_t len = strlen(path);
+    uint32_t lo = 0, hi = record_count, mid;
+    int c;
+    
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        c = _bundle_compare(path, len, &records[mid]);
+        if(c == 0) {
+            return &records[mid];
+        }
+        if(c < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    
+    return NULL;
+}
+
+/**
+ * Get a stored version of a file. 
+ * @param rec the index record. 
+ * @param kind the version to get. 
+ * @param size filled with the size of the data. 
+ * @param etag filled with the entity tag of the data. 
+ * @return the data or NULL when this version is not stored. 
+ */
+const unsigned char* bundle_get_blob(const struct bundle_record* rec, enum bundle_blob_kind kind, size_t* size, const char** etag)
+{
+    const struct bundle_blob* b = &rec->blobs[kind];
+    
+    /* Only the identity version of an empty file has size 0 */
+    if(b->etag[0] == '\0') {
+        return NULL;
+    }
+    
+    *size = le32toh(b->size);
+    *etag = b->etag;
+    return map + le32toh(b->offset);
+}
+
+/**
+ * Get the modification time of a file. 
+ * @param rec the index record. 
+ * @return the modification time of the original file. 
+ */
+time_t bundle_get_mtime(const struct bundle_record* rec)
+{
+    return (time_t) le64toh(rec->mtime);
+}
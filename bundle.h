@@ -0,0 +1,130 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   bundle.h
+ * Created on October 17, 2026, 10:12 AM
+ */
+
+#ifndef BUNDLE_H
+#define	BUNDLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define BUNDLE_MAGIC        "DPTPACK1"                  // Magic at the start of every bundle
+#define BUNDLE_ETAG_LEN     24                          // Room for a quoted entity tag
+
+/**
+ * The versions of a file stored in a bundle. 
+ */
+enum bundle_blob_kind {
+    BUNDLE_BLOB_IDENTITY = 0,                           /* The file as is */
+    BUNDLE_BLOB_GZIP,                                   /* gzip encoded */
+    BUNDLE_BLOB_BR,                                     /* brotli encoded */
+    BUNDLE_BLOB_COUNT
+};
+
+/*
+ * On-disk layout, all integers are little endian: 
+ *   struct bundle_header
+ *   file data and path strings
+ *   struct bundle_record[count] at index_offset, sorted by path
+ */
+
+/**
+ * Bundle file header. 
+ */
+struct bundle_header {
+    char magic[8];                                      /* BUNDLE_MAGIC without terminator */
+    uint32_t count;                                     /* Number of files */
+    uint32_t index_offset;                              /* Offset of the sorted index */
+};
+
+/**
+ * One version of a file in the bundle. 
+ */
+struct bundle_blob {
+    uint32_t offset;                                    /* Offset of the data in the bundle */
+    uint32_t size;                                      /* Size of the data */
+    char etag[BUNDLE_ETAG_LEN];                         /* Quoted entity tag, empty when the version is absent */
+};
+
+/**
+ * Index record of a file in the bundle. 
+ */
+struct bundle_record {
+    uint32_t path_offset;                               /* Offset of the path, relative to the HTML root */
+    uint32_t path_length;                               /* Length of the path */
+    uint64_t mtime;                                     /* Modification time of the original file */
+    struct bundle_blob blobs[BUNDLE_BLOB_COUNT];        /* The stored versions */
+};
+
+/**
+ * Map a bundle in memory and check its index. 
+ * @param path the bundle file. 
+ * @return true on success. 
+ */
+bool bundle_open(const char* path);
+
+/**
+ * Unmap the bundle. 
+ */
+void bundle_close();
+
+/**
+ * Check if files are served from a bundle. 
+ * @return true when a bundle is open. 
+ */
+bool bundle_enabled();
+
+/**
+ * Find a file in the bundle. 
+ * @param path the path relative to the HTML root, starting with '/'. 
+ * @return the index record or NULL when not in the bundle. 
+ */
+const struct bundle_record* bundle_find(const char* path);
+
+/**
+ * Get a stored version of a file. 
+ * @param rec the index record. 
+ * @param kind the version to get. 
+ * @param size filled with the size of the data. 
+ * @param etag filled with the entity tag of the data. 
+ * @return the data or NULL when this version is not stored. 
+ */
+const unsigned char* bundle_get_blob(const struct bundle_record* rec, enum bundle_blob_kind kind, size_t* size, const char** etag);
+
+/**
+ * Get the modification time of a file. 
+ * @param rec the index record. 
+ * @return the modification time of the original file. 
+ */
+time_t bundle_get_mtime(const struct bundle_record* rec);
+
+#endif
+
@@ -0,0 +1,840 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   cache.c
+ * Created on October 17, 2026, 10:12 AM
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <sys/inotify.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "cache.h"
+#include "config.h"
+#include "logger.h"
+
+#define CACHE_WATCH_MASK    (IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                             IN_DELETE_SELF | IN_MOVE_SELF)
+
+/**
+ * Mapping of an inotify watch descriptor to a directory. 
+ */
+struct cache_watch {
+    int wd;
+    char* dir;
+};
+
+static struct cache_entry* buckets[DPT_WEB_IDE_CACHE_BUCKETS];      /* Hash table of cached files */
+static struct cache_entry* lru_head = NULL;                         /* Most recently used entry */
+static struct cache_entry* lru_tail = NULL;                         /* Least recently used entry */
+static struct cache_watch* watches = NULL;                          /* Watched directories */
+static size_t watch_count = 0;                                      /* Number of watched directories */
+static struct cache_stats stats;                                    /* Usage counters */
+static size_t max_size = 0;                                         /* Memory cap for file data */
+static size_t max_variant_size = 0;                                 /* Memory cap for encoded versions */
+static int inotify_fd = -1;                                         /* The inotify instance */
+static char* root_dir = NULL;                                       /* The watched HTML tree */
+static bool root_watched = false;                                   /* False while the tree is gone */
+static time_t root_retry = 0;                                       /* Last attempt to watch a new tree */
+
+const char* const cache_encoding_names[CACHE_ENCODING_COUNT] = { "gzip", "br" };
+const char* const cache_encoding_suffixes[CACHE_ENCODING_COUNT] = { ".gz", ".br" };
+
+/**
+ * FNV-1a hash of a string. 
+ * @param str the string to hash. 
+ * @return the 32 bit hash. 
+ */
+static uint32_t _cache_hash(const char* str)
+{
+    uint32_t h = 2166136261u;
+    
+    while(*str) {
+        h ^= (unsigned char) *str++;
+        h *= 16777619u;
+    }
+    
+    return h;
+}
+
+/**
+ * Unlink an entry from the LRU list. 
+ * @param e the entry to unlink. 
+ */
+static void _cache_lru_unlink(struct cache_entry* e)
+{
+    if(e->lru_prev) {
+        e->lru_prev->lru_next = e->lru_next;
+    } else {
+        lru_head = e->lru_next;
+    }
+    
+    if(e->lru_next) {
+        e->lru_next->lru_prev = e->lru_prev;
+    } else {
+        lru_tail = e->lru_prev;
+    }
+    
+    e->lru_prev = e->lru_next = NULL;
+}
+
+/**
+ * Put an entry in front of the LRU list. 
+ * @param e the entry to move. 
+ */
+static void _cache_lru_push(struct cache_entry* e)
+{
+    e->lru_prev = NULL;
+    e->lru_next = lru_head;
+    if(lru_head) {
+        lru_head->lru_prev = e;
+    }
+    lru_head = e;
+    if(lru_tail == NULL) {
+        lru_tail = e;
+    }
+}
+
+/**
+ * Drop the last reference to an entry and free it. 
+ * @param e the entry to unref. 
+ */
+static void _cache_unref(struct cache_entry* e)
+{
+    if(--e->refs > 0) {
+        return;
+    }
+    
+    free(e->data);
+    free(e->path);
+    free(e);
+}
+
+/**
+ * Drop the encoded versions of an entry. 
+ * @param e the entry to strip. 
+ */
+static void _cache_drop_variants(struct cache_entry* e)
+{
+    int i;
+    
+    for(i = 0; i < CACHE_ENCODING_COUNT; ++i) {
+        if(e->variants[i]) {
+            stats.variant_bytes -= e->variants[i]->size;
+            _cache_unref(e->variants[i]);
+            e->variants[i] = NULL;
+        }
+        e->variant_state[i] = CACHE_VARIANT_UNKNOWN;
+    }
+}
+
+/**
+ * Remove an entry from the table. Running transfers keep their 
+ * reference until they complete. 
+ * @param e the entry to remove. 
+ */
+static void _cache_remove(struct cache_entry* e)
+{
+    struct cache_entry** pp = &buckets[e->hash % DPT_WEB_IDE_CACHE_BUCKETS];
+    
+    while(*pp && *pp != e) {
+        pp = &(*pp)->next;
+    }
+    if(*pp) {
+        *pp = e->next;
+    }
+    
+    _cache_lru_unlink(e);
+    _cache_drop_variants(e);
+    stats.bytes -= e->size;
+    stats.entries--;
+    _cache_unref(e);
+}
+
+/**
+ * Find an entry in the table. 
+ * @param path the full filepath. 
+ * @param hash the hash of the path. 
+ * @return the entry or NULL when not cached. 
+ */
+static struct cache_entry* _cache_find(const char* path, uint32_t hash)
+{
+    struct cache_entry* e = buckets[hash % DPT_WEB_IDE_CACHE_BUCKETS];
+    
+    while(e && (e->hash != hash || strcmp(e->path, path))) {
+        e = e->next;
+    }
+    
+    return e;
+}
+
+/**
+ * Read a complete file in memory. 
+ * @param path the file to read. 
+ * @param size filled with the file size. 
+ * @param limit the maximum file size. 
+ * @param st filled with the file status. 
+ * @return the file data or NULL on error or when the file is to large. 
+ */
+static unsigned char* _cache_read_file(const char* path, size_t* size, size_t limit, struct stat* st_out)
+{
+    struct stat st;
+    unsigned char* data;
+    size_t done = 0;
+    ssize_t n;
+    int fd;
+    
+    if((fd = open(path, O_RDONLY)) < 0) {
+        return NULL;
+    }
+    
+    if(fstat(fd, &st) || !S_ISREG(st.st_mode) || (size_t) st.st_size > limit) {
+        close(fd);
+        return NULL;
+    }
+    
+    /* Allocate at least one byte so empty files can be cached too */
+    if((data = malloc(st.st_size ? st.st_size : 1)) == NULL) {
+        log_message(LOG_ERROR, "Could not allocate %d bytes for cached file %s\r\n", (int) st.st_size, path);
+        close(fd);
+        return NULL;
+    }
+    
+    while(done < (size_t) st.st_size) {
+        n = read(fd, data + done, st.st_size - done);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            free(data);
+            close(fd);
+            return NULL;
+        }
+        done += n;
+    }
+    
+    close(fd);
+    *size = done;
+    *st_out = st;
+    return data;
+}
+
+#ifdef HAVE_ZLIB
+/**
+ * Compress a buffer in the gzip format. 
+ * @param data the data to compress. 
+ * @param size the size of the data. 
+ * @param out_size filled with the compressed size. 
+ * @return the compressed data or NULL when it is not smaller than the original. 
+ */
+static unsigned char* _cache_gzip(const unsigned char* data, size_t size, size_t* out_size)
+{
+    unsigned char* out;
+    z_stream zs;
+    
+    memset(&zs, 0, sizeof(zs));
+    if(deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+    
+    /* Only worth keeping when it ends up smaller than the original */
+    if((out = malloc(size)) == NULL) {
+        deflateEnd(&zs);
+        return NULL;
+    }
+    
+    zs.next_in = (unsigned char*) data;
+    zs.avail_in = size;
+    zs.next_out = out;
+    zs.avail_out = size;
+    
+    if(deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+        deflateEnd(&zs);
+        free(out);
+        return NULL;
+    }
+    
+    *out_size = zs.total_out;
+    deflateEnd(&zs);
+    return out;
+}
+#endif
+
+/**
+ * Drop encoded versions of the least recently used files until there 
+ * is room for a new one. Nothing is dropped for a version that can't be 
+ * kept even with all other files dropped. 
+ * @param size the size of the new encoded version. 
+ * @param keep the entry that gets the new version. 
+ * @return true when there is room for the new version. 
+ */
+static bool _cache_trim_variants(size_t size, const struct cache_entry* keep)
+{
+    struct cache_entry* e = lru_tail;
+    size_t own = size;
+    int i;
+    
+    for(i = 0; i < CACHE_ENCODING_COUNT; ++i) {
+        if(keep->variants[i]) {
+            own += keep->variants[i]->size;
+        }
+    }
+    if(own > max_variant_size) {
+        return false;
+    }
+    
+    while(e && stats.variant_bytes + size > max_variant_size) {
+        if(e != keep) {
+            _cache_drop_variants(e);
+        }
+        e = e->lru_prev;
+    }
+    
+    return stats.variant_bytes + size <= max_variant_size;
+}
+
+/**
+ * Start watching a directory and all of its subdirectories. 
+ * @param dir the directory to watch. 
+ * @return true when the directory itself is watched. 
+ */
+static bool _cache_watch_tree(const char* dir)
+{
+    char path[DPT_WEB_IDE_HTTP_PATH_BUFF];
+    struct cache_watch* w;
+    struct dirent* ent;
+    struct stat st;
+    DIR* d;
+    int wd;
+    
+    if((wd = inotify_add_watch(inotify_fd, dir, CACHE_WATCH_MASK)) < 0) {
+        // A directory that is already gone again is normal while deploying
+        log_message(errno == ENOENT ? LOG_DEBUG : LOG_WARNING, "Could not watch %s for changes: %s\r\n", dir, strerror(errno));
+        return false;
+    }
+    
+    if((w = realloc(watches, (watch_count + 1) * sizeof(struct cache_watch))) == NULL) {
+        inotify_rm_watch(inotify_fd, wd);
+        return false;
+    }
+    watches = w;
+    watches[watch_count].wd = wd;
+    watches[watch_count].dir = strdup(dir);
+    watch_count++;
+    
+    if((d = opendir(dir)) == NULL) {
+        return true;
+    }
+    
+    while((ent = readdir(d)) != NULL) {
+        if(ent->d_name[0] == '.') {
+            continue;
+        }
+        
+        if(snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name) >= (int) sizeof(path)) {
+            continue;
+        }
+        if(stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            _cache_watch_tree(path);
+        }
+    }
+    
+    closedir(d);
+    return true;
+}
+
+/**
+ * Lookup the directory that belongs to a watch descriptor. 
+ * @param wd the watch descriptor. 
+ * @return the directory or NULL when unknown. 
+ */
+static const char* _cache_watch_dir(int wd)
+{
+    size_t i;
+    
+    for(i = 0; i < watch_count; ++i) {
+        if(watches[i].wd == wd) {
+            return watches[i].dir;
+        }
+    }
+    
+    return NULL;
+}
+
+/**
+ * Drop every entry from the table. 
+ */
+static void _cache_flush()
+{
+    while(lru_head) {
+        _cache_remove(lru_head);
+    }
+}
+
+/**
+ * Check whether a path lies inside a directory. 
+ * @param path the path. 
+ * @param dir the directory. 
+ * @return true when path is below dir. 
+ */
+static bool _cache_in_dir(const char* path, const char* dir)
+{
+    size_t len = strlen(dir);
+    
+    return strncmp(path, dir, len) == 0 && path[len] == '/';
+}
+
+/**
+ * Drop every cached file below a directory that was created, moved or 
+ * deleted. 
+ * @param dir the directory. 
+ */
+static void _cache_invalidate_tree(const char* dir)
+{
+    struct cache_entry* e = lru_head;
+    struct cache_entry* next;
+    
+    for(; e != NULL; e = next) {
+        next = e->lru_next;
+        if(_cache_in_dir(e->path, dir)) {
+            log_message(LOG_DEBUG, "Invalidating cached file %s\r\n", e->path);
+            stats.invalidations++;
+            _cache_remove(e);
+        }
+    }
+}
+
+/**
+ * Forget a watch descriptor mapping. 
+ * @param i the index of the mapping. 
+ */
+static void _cache_forget_watch(size_t i)
+{
+    free(watches[i].dir);
+    watches[i] = watches[--watch_count];
+}
+
+/**
+ * Stop watching a directory and its subdirectories, their names are no 
+ * longer valid after a move or delete. 
+ * @param dir the directory. 
+ */
+static void _cache_unwatch_tree(const char* dir)
+{
+    size_t i = 0;
+    
+    while(i < watch_count) {
+        if(strcmp(watches[i].dir, dir) == 0 || _cache_in_dir(watches[i].dir, dir)) {
+            inotify_rm_watch(inotify_fd, watches[i].wd);
+            _cache_forget_watch(i);
+        } else {
+            i++;
+        }
+    }
+}
+
+/**
+ * The HTML tree itself was moved or deleted, nothing cached can be 
+ * trusted and nothing is cached until a new tree can be watched. 
+ */
+static void _cache_lose_root()
+{
+    log_message(LOG_WARNING, "%s was moved or deleted, flushing static asset cache\r\n", root_dir);
+    stats.invalidations += stats.entries;
+    _cache_flush();
+    while(watch_count > 0) {
+        inotify_rm_watch(inotify_fd, watches[0].wd);
+        _cache_forget_watch(0);
+    }
+    root_watched = false;
+    root_retry = time(NULL);
+}
+
+/**
+ * Make sure the HTML tree is watched, a replaced tree is picked up at 
+ * most once a second. 
+ * @return true when cached files are invalidated on changes. 
+ */
+static bool _cache_watch_root()
+{
+    if(!root_watched && time(NULL) != root_retry) {
+        root_retry = time(NULL);
+        if((root_watched = _cache_watch_tree(root_dir))) {
+            log_message(LOG_INFO, "Watching %s again\r\n", root_dir);
+        }
+    }
+    
+    return root_watched;
+}
+
+/**
+ * Handle an event about a watched directory itself. 
+ * @param ev the event. 
+ */
+static void _cache_watch_event(const struct inotify_event* ev)
+{
+    size_t i;
+    
+    for(i = 0; i < watch_count && watches[i].wd != ev->wd; ++i);
+    if(i == watch_count) {
+        return;
+    }
+    
+    // Subdirectories are handled through the event of their parent
+    if(strcmp(watches[i].dir, root_dir) == 0) {
+        _cache_lose_root();
+    } else if(ev->mask & IN_IGNORED) {
+        _cache_forget_watch(i);
+    }
+}
+
+/**
+ * Initialize the static asset cache and start watching the HTML tree. 
+ * @param root the directory to watch for changes. 
+ * @param max_bytes the maximum amount of file data to keep in memory, 0 disables the cache. 
+ * @param max_variant_bytes the maximum amount of memory for encoded versions of files. 
+ * @return true on success, false when the cache is disabled or could not be set up. 
+ */
+bool cache_init(const char* root, size_t max_bytes, size_t max_variant_bytes)
+{
+    max_size = max_bytes;
+    max_variant_size = max_variant_bytes;
+    if(max_size == 0) {
+        log_message(LOG_INFO, "Static asset cache is disabled\r\n");
+        return false;
+    }
+    
+    if((inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        log_message(LOG_ERROR, "Could not initialize inotify, static asset cache disabled: %s\r\n", strerror(errno));
+        max_size = 0;
+        return false;
+    }
+    
+    root_dir = strdup(root);
+    root_watched = root_dir != NULL && _cache_watch_tree(root_dir);
+    log_message(LOG_INFO, "Static asset cache enabled, %d KB for %d directories\r\n", (int) (max_size / 1024), (int) watch_count);
+    return true;
+}
+
+/**
+ * Drop all entries and stop watching the HTML tree. 
+ */
+void cache_free()
+{
+    size_t i;
+    
+    _cache_flush();
+    
+    for(i = 0; i < watch_count; ++i) {
+        free(watches[i].dir);
+    }
+    free(watches);
+    watches = NULL;
+    watch_count = 0;
+    free(root_dir);
+    root_dir = NULL;
+    root_watched = false;
+    
+    if(inotify_fd >= 0) {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+    max_size = 0;
+}
+
+/**
+ * Format a strong entity tag from the identity of a file. 
+ * @param buf the buffer to write to, at least DPT_WEB_IDE_ETAG_BUFF bytes. 
+ * @param st the file status. 
+ */
+void cache_format_etag(char* buf, const struct stat* st)
+{
+    snprintf(buf, DPT_WEB_IDE_ETAG_BUFF, "\"%lx-%lx-%lx\"", (unsigned long) st->st_ino, 
+            (unsigned long) st->st_mtime, (unsigned long) st->st_size);
+}
+
+/**
+ * Get a file from the cache, loading it from disk on a miss. The returned
+ * entry must be given back with cache_release when the transfer is done. 
+ * @param path the full filepath. 
+ * @param mimetype the mimetype to store with the file. 
+ * @return the cache entry or NULL when the file can't be cached. 
+ */
+struct cache_entry* cache_get(const char* path, const char* mimetype)
+{
+    struct cache_entry* e;
+    struct stat st;
+    uint32_t hash;
+    
+    // Files are only cached while a change to them can be noticed
+    if(max_size == 0 || !_cache_watch_root()) {
+        return NULL;
+    }
+    
+    hash = _cache_hash(path);
+    
+    /* Hit, serve without touching the filesystem */
+    if((e = _cache_find(path, hash)) != NULL) {
+        stats.hits++;
+        _cache_lru_unlink(e);
+        _cache_lru_push(e);
+        e->refs++;
+        return e;
+    }
+    
+    stats.misses++;
+    
+    if((e = calloc(1, sizeof(struct cache_entry))) == NULL) {
+        return NULL;
+    }
+    
+    if((e->data = _cache_read_file(path, &e->size, max_size, &st)) == NULL || (e->path = strdup(path)) == NULL) {
+        free(e->data);
+        free(e);
+        return NULL;
+    }
+    
+    e->mimetype = mimetype;
+    e->hash = hash;
+    e->mtime = st.st_mtime;
+    cache_format_etag(e->etag, &st);
+    
+    /* Make room by evicting the least recently used files */
+    while(lru_tail && stats.bytes + e->size > max_size) {
+        stats.evictions++;
+        _cache_remove(lru_tail);
+    }
+    
+    e->next = buckets[hash % DPT_WEB_IDE_CACHE_BUCKETS];
+    buckets[hash % DPT_WEB_IDE_CACHE_BUCKETS] = e;
+    _cache_lru_push(e);
+    stats.bytes += e->size;
+    stats.entries++;
+    
+    /* One reference for the table, one for the caller */
+    e->refs = 2;
+    return e;
+}
+
+/**
+ * Get an encoded version of a cached file. A precompressed sibling on 
+ * disk (path + suffix) is preferred, otherwise gzip is produced once on 
+ * demand. A version too large for the variant cap is read or compressed 
+ * again for every request. The returned entry must be given back with 
+ * cache_release. 
+ * @param entry the cached original file. 
+ * @param encoding the wanted content encoding. 
+ * @param compress true when the file may be compressed on demand. 
+ * @return the encoded version or NULL when it is not available. 
+ */
+struct cache_entry* cache_get_variant(struct cache_entry* entry, enum cache_encoding encoding, bool compress)
+{
+    char path[DPT_WEB_IDE_HTTP_PATH_BUFF];
+    unsigned char* data = NULL;
+    struct cache_entry* v;
+    size_t size = 0;
+    struct stat st;
+    bool missing = false;
+    
+    if(entry->variants[encoding]) {
+        entry->variants[encoding]->refs++;
+        return entry->variants[encoding];
+    }
+    
+    if(entry->variant_state[encoding] == CACHE_VARIANT_ABSENT || max_variant_size == 0) {
+        return NULL;
+    }
+    
+    if((v = calloc(1, sizeof(struct cache_entry))) == NULL) {
+        return NULL;
+    }
+    
+    /* Prefer a precompressed sibling, compress gzip ourselves otherwise */
+    if(snprintf(path, sizeof(path), "%s%s", entry->path, cache_encoding_suffixes[encoding]) < (int) sizeof(path)) {
+        errno = 0;
+        data = _cache_read_file(path, &size, max_size, &st);
+        missing = data == NULL && errno == ENOENT;
+    }
+    
+    if(data != NULL) {
+        /* The sibling has its own identity on disk */
+        v->mtime = st.st_mtime;
+        cache_format_etag(v->etag, &st);
+    }
+#ifdef HAVE_ZLIB
+    else if(compress && encoding == CACHE_ENCODING_GZIP && entry->size >= DPT_WEB_IDE_GZIP_MIN_SIZE) {
+        if((data = _cache_gzip(entry->data, entry->size, &size)) != NULL) {
+            /* Derived from the original, tagged so it never matches the identity version */
+            stats.compressions++;
+            v->mtime = entry->mtime;
+            snprintf(v->etag, sizeof(v->etag), "%.*s-%s\"", (int) strlen(entry->etag) - 1, entry->etag, cache_encoding_names[encoding]);
+        }
+    }
+#endif
+    if(data == NULL) {
+        /* Only remember a version that can't exist, a sibling that failed to load is tried again */
+        if(missing) {
+            entry->variant_state[encoding] = CACHE_VARIANT_ABSENT;
+        }
+        free(v);
+        return NULL;
+    }
+    
+    v->data = data;
+    v->size = size;
+    v->mimetype = entry->mimetype;
+    v->refs = 1;
+    
+    /* Keep it for the next request when it fits in the variant cap */
+    if(_cache_trim_variants(size, entry)) {
+        entry->variants[encoding] = v;
+        entry->variant_state[encoding] = CACHE_VARIANT_PRESENT;
+        stats.variant_bytes += size;
+        v->refs++;
+    } else {
+        entry->variant_state[encoding] = CACHE_VARIANT_OVERSIZE;
+    }
+    
+    return v;
+}
+
+/**
+ * Release a cache entry obtained with cache_get. 
+ * @param entry the entry to release. 
+ */
+void cache_release(struct cache_entry* entry)
+{
+    if(entry) {
+        _cache_unref(entry);
+    }
+}
+
+/**
+ * Process pending inotify events and invalidate changed files. This 
+ * never blocks. 
+ */
+void cache_poll()
+{
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    char path[DPT_WEB_IDE_HTTP_PATH_BUFF];
+    const struct inotify_event* ev;
+    struct cache_entry* e;
+    size_t slen, xlen;
+    const char* dir;
+    ssize_t n;
+    char* p;
+    int i;
+    
+    if(inotify_fd < 0) {
+        return;
+    }
+    
+    while((n = read(inotify_fd, buf, sizeof(buf))) > 0) {
+        for(p = buf; p < buf + n; p += sizeof(struct inotify_event) + ev->len) {
+            ev = (const struct inotify_event*) p;
+            
+            /* Lost events, nothing in the table can be trusted */
+            if(ev->mask & IN_Q_OVERFLOW) {
+                log_message(LOG_WARNING, "inotify queue overflow, flushing static asset cache\r\n");
+                stats.invalidations += stats.entries;
+                _cache_flush();
+                continue;
+            }
+            
+            if(ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                _cache_watch_event(ev);
+                continue;
+            }
+            
+            if(ev->len == 0 || (dir = _cache_watch_dir(ev->wd)) == NULL) {
+                continue;
+            }
+            
+            if(snprintf(path, sizeof(path), "%s/%s", dir, ev->name) >= (int) sizeof(path)) {
+                continue;
+            }
+            
+            /* Whatever was cached under a directory that came, went or moved is stale */
+            if(ev->mask & IN_ISDIR) {
+                _cache_invalidate_tree(path);
+                _cache_unwatch_tree(path);
+                if(ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    _cache_watch_tree(path);
+                }
+                continue;
+            }
+            
+            if((e = _cache_find(path, _cache_hash(path))) != NULL) {
+                log_message(LOG_DEBUG, "Invalidating cached file %s\r\n", path);
+                stats.invalidations++;
+                _cache_remove(e);
+            }
+            
+            /* A precompressed sibling changed, forget what we know about it */
+            for(i = 0; i < CACHE_ENCODING_COUNT; ++i) {
+                slen = strlen(path);
+                xlen = strlen(cache_encoding_suffixes[i]);
+                if(slen > xlen && strcmp(path + slen - xlen, cache_encoding_suffixes[i]) == 0) {
+                    path[slen - xlen] = '\0';
+                    if((e = _cache_find(path, _cache_hash(path))) != NULL) {
+                        _cache_drop_variants(e);
+                    }
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Get the inotify file descriptor of the cache. 
+ * @return the file descriptor or -1 when the cache is disabled. 
+ */
+int cache_get_fd()
+{
+    return inotify_fd;
+}
+
+/**
+ * Get the cache usage counters. 
+ * @param s the structure to fill. 
+ */
+void cache_get_stats(struct cache_stats* s)
+{
+    *s = stats;
+}
@@ -0,0 +1,170 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   cache.h
+ * Created on October 17, 2026, 10:12 AM
+ */
+
+#ifndef CACHE_H
+#define	CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "config.h"
+
+/**
+ * Content encodings a cached file can be stored in. 
+ */
+enum cache_encoding {
+    CACHE_ENCODING_GZIP = 0,
+    CACHE_ENCODING_BR,
+    CACHE_ENCODING_COUNT
+};
+
+/**
+ * What is known about an encoded variant of a cached file. 
+ */
+enum cache_variant_state {
+    CACHE_VARIANT_UNKNOWN = 0,                          /* Not looked for yet */
+    CACHE_VARIANT_ABSENT,                               /* No sibling and not compressible */
+    CACHE_VARIANT_PRESENT,                              /* Held in memory */
+    CACHE_VARIANT_OVERSIZE                              /* Too large to keep, built again for every request */
+};
+
+/**
+ * A file from the HTML tree held in memory. 
+ */
+struct cache_entry {
+    char* path;                                         /* The filesystem path, used as lookup key */
+    unsigned char* data;                                /* The file contents */
+    size_t size;                                        /* The file size in bytes */
+    const char* mimetype;                               /* The resolved mimetype */
+    time_t mtime;                                       /* Modification time of the file on disk */
+    char etag[DPT_WEB_IDE_ETAG_BUFF];                   /* Strong entity tag of the contents */
+    uint32_t hash;                                      /* Hash of the path */
+    int refs;                                           /* Active transfers, +1 while in the table */
+    struct cache_entry* next;                           /* Next entry in the hash bucket */
+    struct cache_entry* lru_prev;                       /* Previous (more recently used) entry */
+    struct cache_entry* lru_next;                       /* Next (less recently used) entry */
+    struct cache_entry* variants[CACHE_ENCODING_COUNT]; /* Encoded versions of the file */
+    unsigned char variant_state[CACHE_ENCODING_COUNT];  /* State of each encoded version */
+};
+
+/**
+ * Cache usage counters. 
+ */
+struct cache_stats {
+    unsigned long hits;                                 /* Lookups served from memory */
+    unsigned long misses;                               /* Lookups that had to go to disk */
+    unsigned long evictions;                            /* Entries dropped to stay under the cap */
+    unsigned long invalidations;                        /* Entries dropped by inotify */
+    size_t bytes;                                       /* Memory currently used by file data */
+    size_t entries;                                     /* Number of cached files */
+    unsigned long compressions;                         /* Files compressed on demand */
+    size_t variant_bytes;                               /* Memory used by encoded versions */
+};
+
+/**
+ * The Content-Encoding name of each cache encoding. 
+ */
+extern const char* const cache_encoding_names[CACHE_ENCODING_COUNT];
+
+/**
+ * The filename suffix of precompressed siblings for each cache encoding. 
+ */
+extern const char* const cache_encoding_suffixes[CACHE_ENCODING_COUNT];
+
+/**
+ * Initialize the static asset cache and start watching the HTML tree. 
+ * @param root the directory to watch for changes. 
+ * @param max_bytes the maximum amount of file data to keep in memory, 0 disables the cache. 
+ * @param max_variant_bytes the maximum amount of memory for encoded versions of files. 
+ * @return true on success, false when the cache is disabled or could not be set up. 
+ */
+bool cache_init(const char* root, size_t max_bytes, size_t max_variant_bytes);
+
+/**
+ * Drop all entries and stop watching the HTML tree. 
+ */
+void cache_free();
+
+/**
+ * Format a strong entity tag from the identity of a file. 
+ * @param buf the buffer to write to, at least DPT_WEB_IDE_ETAG_BUFF bytes. 
+ * @param st the file status. 
+ */
+void cache_format_etag(char* buf, const struct stat* st);
+
+/**
+ * Get a file from the cache, loading it from disk on a miss. The returned
+ * entry must be given back with cache_release when the transfer is done. 
+ * @param path the full filepath. 
+ * @param mimetype the mimetype to store with the file. 
+ * @return the cache entry or NULL when the file can't be cached. 
+ */
+struct cache_entry* cache_get(const char* path, const char* mimetype);
+
+/**
+ * Get an encoded version of a cached file. A precompressed sibling on 
+ * disk (path + suffix) is preferred, otherwise gzip is produced once on 
+ * demand. The returned entry must be given back with cache_release. 
+ * @param entry the cached original file. 
+ * @param encoding the wanted content encoding. 
+ * @param compress true when the file may be compressed on demand. 
+ * @return the encoded version or NULL when it is not available. 
+ */
+struct cache_entry* cache_get_variant(struct cache_entry* entry, enum cache_encoding encoding, bool compress);
+
+/**
+ * Release a cache entry obtained with cache_get. 
+ * @param entry the entry to release. 
+ */
+void cache_release(struct cache_entry* entry);
+
+/**
+ * Process pending inotify events and invalidate changed files. This 
+ * never blocks. 
+ */
+void cache_poll();
+
+/**
+ * Get the inotify file descriptor of the cache. 
+ * @return the file descriptor or -1 when the cache is disabled. 
+ */
+int cache_get_fd();
+
+/**
+ * Get the cache usage counters. 
+ * @param s the structure to fill. 
+ */
+void cache_get_stats(struct cache_stats* s);
+
+#endif
+
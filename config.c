@@ -135,6 +135,74 @@ static int parseint(char* string, bool unsignedint, int fallback) {
 }
 
 
+/**
+ * Parse a 'mimetype <extension> <type> [cache-control]' configuration line. 
+ * @param line the line after the key, the cache control policy is the rest of the line. 
+ * @return true when the mimetype was added. 
+ */
+static bool _config_add_mimetype(char* line) {
+    config_mimetype* types;
+    char* extn = strtok(line, " \t");
+    char* mime = strtok(NULL, " \t");
+    char* cache_control = strtok(NULL, "");
+    
+    if(extn == NULL || mime == NULL) {
+        log_message(LOG_WARNING, "mimetype needs an extension and a type\r\n");
+        return false;
+    }
+    
+    if(strlen(extn) >= DPT_WEB_IDE_MIME_EXT_LEN) {
+        log_message(LOG_WARNING, "mimetype extension '%s' is to long\r\n", extn);
+        return false;
+    }
+    
+    types = (config_mimetype*) realloc(conf->mimetypes, (conf->mimetype_count + 1) * sizeof(config_mimetype));
+    if(types == NULL) {
+        log_message(LOG_ERROR, "Could not allocate memory for mimetype '%s'\r\n", extn);
+        return false;
+    }
+    conf->mimetypes = types;
+    
+    types[conf->mimetype_count].extn = strmalloc(NULL, extn);
+    types[conf->mimetype_count].mime = strmalloc(NULL, mime);
+    types[conf->mimetype_count].cache_control = NULL;
+    if(cache_control != NULL) {
+        cache_control = trimwhitespace(cache_control);
+        if(*cache_control) {
+            types[conf->mimetype_count].cache_control = strmalloc(NULL, cache_control);
+        }
+    }
+    conf->mimetype_count++;
+    
+    return true;
+}
+
+/**
+ * Set an option that takes the whole rest of the line, paths and names 
+ * may contain the characters that separate the other values. 
+ * @param key the option. 
+ * @param value the trimmed rest of the line. 
+ * @return true when the key is such an option. 
+ */
+static bool _config_set_path(const char* key, const char* value) {
+    char** field;
+    
+    if(strcmp(key, "run_cgroup") == 0) {
+        field = &conf->run_cgroup;
+    } else if(strcmp(key, "project_path") == 0) {
+        field = &conf->project_path;
+    } else if(strcmp(key, "bundle_path") == 0) {
+        field = &conf->bundle_path;
+    } else if(strcmp(key, "html_path") == 0) {
+        field = &conf->html_path;
+    } else {
+        return false;
+    }
+    
+    *field = strmalloc(*field, value);
+    return true;
+}
+
 config* conf = NULL;
 
 /**
@@ -148,6 +216,7 @@ bool config_parse() {
     FILE * fd;
     char* key;
     char* value;
+    char* rest;
     errno = 0;
     
     /* Reserve memory for configuration and null terminate every string */
@@ -165,10 +234,155 @@ bool config_parse() {
         printf("conf->html_path = %s\r\n", conf->html_path);
 #endif
         
+        conf->bundle_path = strmalloc(conf->bundle_path, DPT_WEB_IDE_BUNDLE_PATH);
+#ifdef DEBUG
+        printf("conf->bundle_path = %s\r\n", conf->bundle_path);
+#endif
+        
+        conf->project_path = strmalloc(conf->project_path, DPT_WEB_IDE_PROJECT_PATH);
+#ifdef DEBUG
+        printf("conf->project_path = %s\r\n", conf->project_path);
+#endif
+        
         conf->port = DPT_WEB_IDE_PORT;
 #ifdef DEBUG  
         printf("conf->port = %d\r\n", conf->port);
 #endif
+        
+        conf->cache_size = DPT_WEB_IDE_CACHE_SIZE;
+#ifdef DEBUG  
+        printf("conf->cache_size = %d\r\n", conf->cache_size);
+#endif
+        
+        conf->sendfile = DPT_WEB_IDE_SENDFILE;
+#ifdef DEBUG
+        printf("conf->sendfile = %s\r\n", conf->sendfile ? "true" : "false");
+#endif
+        
+        conf->compress_cache_size = DPT_WEB_IDE_COMPRESS_CACHE_SIZE;
+#ifdef DEBUG  
+        printf("conf->compress_cache_size = %d\r\n", conf->compress_cache_size);
+#endif
+        
+        conf->upload_max_size = DPT_WEB_IDE_UPLOAD_MAX_SIZE;
+#ifdef DEBUG  
+        printf("conf->upload_max_size = %d\r\n", conf->upload_max_size);
+#endif
+        
+        conf->send_buffer_min = DPT_WEB_IDE_SEND_BUFF_MIN;
+#ifdef DEBUG  
+        printf("conf->send_buffer_min = %d\r\n", conf->send_buffer_min);
+#endif
+        
+        conf->send_buffer_max = DPT_WEB_IDE_SEND_BUFF_MAX;
+#ifdef DEBUG  
+        printf("conf->send_buffer_max = %d\r\n", conf->send_buffer_max);
+#endif
+        
+        conf->pool_size = DPT_WEB_IDE_POOL_SIZE;
+#ifdef DEBUG  
+        printf("conf->pool_size = %d\r\n", conf->pool_size);
+#endif
+        
+        conf->script_handoff = DPT_WEB_IDE_SCRIPT_HANDOFF;
+#ifdef DEBUG  
+        printf("conf->script_handoff = %d\r\n", conf->script_handoff);
+#endif
+        
+        conf->output_buffer_size = DPT_WEB_IDE_OUTPUT_BUFF_SIZE;
+#ifdef DEBUG  
+        printf("conf->output_buffer_size = %d\r\n", conf->output_buffer_size);
+#endif
+        
+        conf->output_policy = DPT_WEB_IDE_OUTPUT_POLICY;
+#ifdef DEBUG  
+        printf("conf->output_policy = %d\r\n", conf->output_policy);
+#endif
+        
+        conf->warm_pool_size = DPT_WEB_IDE_WARM_POOL_SIZE;
+#ifdef DEBUG  
+        printf("conf->warm_pool_size = %d\r\n", conf->warm_pool_size);
+#endif
+        
+        conf->warm_pool_ttl = DPT_WEB_IDE_WARM_POOL_TTL;
+#ifdef DEBUG  
+        printf("conf->warm_pool_ttl = %d\r\n", conf->warm_pool_ttl);
+#endif
+        
+        conf->kill_timeout = DPT_WEB_IDE_KILL_TIMEOUT;
+#ifdef DEBUG  
+        printf("conf->kill_timeout = %d\r\n", conf->kill_timeout);
+#endif
+        
+        conf->max_runs = DPT_WEB_IDE_MAX_RUNS;
+#ifdef DEBUG  
+        printf("conf->max_runs = %d\r\n", conf->max_runs);
+#endif
+        
+        conf->run_cpu_limit = DPT_WEB_IDE_RUN_CPU_LIMIT;
+#ifdef DEBUG  
+        printf("conf->run_cpu_limit = %d\r\n", conf->run_cpu_limit);
+#endif
+        
+        conf->run_memory_limit = DPT_WEB_IDE_RUN_MEMORY_LIMIT;
+#ifdef DEBUG  
+        printf("conf->run_memory_limit = %d\r\n", conf->run_memory_limit);
+#endif
+        
+        conf->run_file_limit = DPT_WEB_IDE_RUN_FILE_LIMIT;
+#ifdef DEBUG  
+        printf("conf->run_file_limit = %d\r\n", conf->run_file_limit);
+#endif
+        
+        conf->run_output_limit = DPT_WEB_IDE_RUN_OUTPUT_LIMIT;
+#ifdef DEBUG  
+        printf("conf->run_output_limit = %d\r\n", conf->run_output_limit);
+#endif
+        
+        conf->run_cgroup = strmalloc(conf->run_cgroup, DPT_WEB_IDE_RUN_CGROUP);
+#ifdef DEBUG  
+        printf("conf->run_cgroup = %s\r\n", conf->run_cgroup);
+#endif
+        
+        conf->max_script_size = DPT_WEB_IDE_MAX_SCRIPT_SIZE;
+#ifdef DEBUG  
+        printf("conf->max_script_size = %d\r\n", conf->max_script_size);
+#endif
+        
+        conf->detach_grace = DPT_WEB_IDE_DETACH_GRACE;
+#ifdef DEBUG  
+        printf("conf->detach_grace = %d\r\n", conf->detach_grace);
+#endif
+        
+        conf->detach_log_size = DPT_WEB_IDE_DETACH_LOG_SIZE;
+#ifdef DEBUG  
+        printf("conf->detach_log_size = %d\r\n", conf->detach_log_size);
+#endif
+        
+        conf->detach_spill_size = DPT_WEB_IDE_DETACH_SPILL_SIZE;
+#ifdef DEBUG  
+        printf("conf->detach_spill_size = %d\r\n", conf->detach_spill_size);
+#endif
+        
+        conf->run_subscribers = DPT_WEB_IDE_RUN_SUBSCRIBERS;
+#ifdef DEBUG  
+        printf("conf->run_subscribers = %d\r\n", conf->run_subscribers);
+#endif
+        
+        conf->workers = DPT_WEB_IDE_WORKERS;
+#ifdef DEBUG  
+        printf("conf->workers = %d\r\n", conf->workers);
+#endif
+        
+        conf->io_threads = DPT_WEB_IDE_IO_THREADS;
+#ifdef DEBUG  
+        printf("conf->io_threads = %d\r\n", conf->io_threads);
+#endif
+        
+        conf->io_uring = DPT_WEB_IDE_IO_URING;
+#ifdef DEBUG  
+        printf("conf->io_uring = %s\r\n", conf->io_uring ? "true" : "false");
+#endif
     }
 
     if ((fd = fopen("/etc/config/dpt-web-ide-server", "r")) != NULL) {
@@ -181,7 +395,17 @@ bool config_parse() {
             if (cfgl[0] != '#' && cfgl[0] != ';' && cfgl[0] != ' ' && cfgl[0] != '\t' && cfgl[0] != '\r' && cfgl[0] != '\n') {
                 char* trimmed = trimwhitespace(buffer);
                 key = strtok(trimmed, " \t");
-                value = strtok (NULL, " ,-");
+                rest = strtok(NULL, "");
+                
+                /* Mimetypes take the raw rest of the line */
+                if(key != NULL && rest != NULL && strcmp(key, "mimetype") == 0) {
+                    _config_add_mimetype(rest);
+                    continue;
+                }
+                if(key != NULL && rest != NULL && _config_set_path(key, trimwhitespace(rest))) {
+                    continue;
+                }
+                value = rest != NULL ? strtok (rest, " ,-") : NULL;
 
 #ifdef DEBUG 
         printf("Parsing configuration line '%s' = '%s'\r\n", key, value);
@@ -191,14 +415,130 @@ bool config_parse() {
                     {
                         conf->daemon = value[0] == 't';
                     } 
-                    else if (strcmp(key, "html_path") == 0) 
-                    {
-                        conf->html_path = strmalloc(conf->html_path, value);
-                    } 
                     else if (strcmp(key, "port") == 0)
                     {
                         conf->port = parseint(value, true, DPT_WEB_IDE_PORT);
                     }
+                    else if (strcmp(key, "cache_size") == 0)
+                    {
+                        conf->cache_size = parseint(value, true, DPT_WEB_IDE_CACHE_SIZE);
+                    }
+                    else if (strcmp(key, "sendfile") == 0)
+                    {
+                        conf->sendfile = value[0] == 't';
+                    }
+                    else if (strcmp(key, "compress_cache_size") == 0)
+                    {
+                        conf->compress_cache_size = parseint(value, true, DPT_WEB_IDE_COMPRESS_CACHE_SIZE);
+                    }
+                    else if (strcmp(key, "upload_max_size") == 0)
+                    {
+                        conf->upload_max_size = parseint(value, true, DPT_WEB_IDE_UPLOAD_MAX_SIZE);
+                    }
+                    else if (strcmp(key, "send_buffer_min") == 0)
+                    {
+                        conf->send_buffer_min = parseint(value, true, DPT_WEB_IDE_SEND_BUFF_MIN);
+                    }
+                    else if (strcmp(key, "send_buffer_max") == 0)
+                    {
+                        conf->send_buffer_max = parseint(value, true, DPT_WEB_IDE_SEND_BUFF_MAX);
+                    }
+                    else if (strcmp(key, "pool_size") == 0)
+                    {
+                        conf->pool_size = parseint(value, true, DPT_WEB_IDE_POOL_SIZE);
+                    }
+                    else if (strcmp(key, "script_handoff") == 0)
+                    {
+                        if(strcmp(value, "memfd") == 0) {
+                            conf->script_handoff = CONFIG_HANDOFF_MEMFD;
+                        } else if(strcmp(value, "stdin") == 0) {
+                            conf->script_handoff = CONFIG_HANDOFF_STDIN;
+                        } else if(strcmp(value, "file") == 0) {
+                            conf->script_handoff = CONFIG_HANDOFF_FILE;
+                        } else {
+                            log_message(LOG_WARNING, "Unknown script hand-off mode: '%s'\r\n", value);
+                        }
+                    }
+                    else if (strcmp(key, "output_buffer_size") == 0)
+                    {
+                        conf->output_buffer_size = parseint(value, true, DPT_WEB_IDE_OUTPUT_BUFF_SIZE);
+                    }
+                    else if (strcmp(key, "output_policy") == 0)
+                    {
+                        if(strcmp(value, "pause") == 0) {
+                            conf->output_policy = CONFIG_OVERFLOW_PAUSE;
+                        } else if(strcmp(value, "drop") == 0) {
+                            conf->output_policy = CONFIG_OVERFLOW_DROP;
+                        } else if(strcmp(value, "kill") == 0) {
+                            conf->output_policy = CONFIG_OVERFLOW_KILL;
+                        } else {
+                            log_message(LOG_WARNING, "Unknown output overflow policy: '%s'\r\n", value);
+                        }
+                    }
+                    else if (strcmp(key, "warm_pool_size") == 0)
+                    {
+                        conf->warm_pool_size = parseint(value, true, DPT_WEB_IDE_WARM_POOL_SIZE);
+                    }
+                    else if (strcmp(key, "warm_pool_ttl") == 0)
+                    {
+                        conf->warm_pool_ttl = parseint(value, true, DPT_WEB_IDE_WARM_POOL_TTL);
+                    }
+                    else if (strcmp(key, "kill_timeout") == 0)
+                    {
+                        conf->kill_timeout = parseint(value, true, DPT_WEB_IDE_KILL_TIMEOUT);
+                    }
+                    else if (strcmp(key, "max_runs") == 0)
+                    {
+                        conf->max_runs = parseint(value, true, DPT_WEB_IDE_MAX_RUNS);
+                    }
+                    else if (strcmp(key, "run_cpu_limit") == 0)
+                    {
+                        conf->run_cpu_limit = parseint(value, true, DPT_WEB_IDE_RUN_CPU_LIMIT);
+                    }
+                    else if (strcmp(key, "run_memory_limit") == 0)
+                    {
+                        conf->run_memory_limit = parseint(value, true, DPT_WEB_IDE_RUN_MEMORY_LIMIT);
+                    }
+                    else if (strcmp(key, "run_file_limit") == 0)
+                    {
+                        conf->run_file_limit = parseint(value, true, DPT_WEB_IDE_RUN_FILE_LIMIT);
+                    }
+                    else if (strcmp(key, "run_output_limit") == 0)
+                    {
+                        conf->run_output_limit = parseint(value, true, DPT_WEB_IDE_RUN_OUTPUT_LIMIT);
+                    }
+                    else if (strcmp(key, "max_script_size") == 0)
+                    {
+                        conf->max_script_size = parseint(value, true, DPT_WEB_IDE_MAX_SCRIPT_SIZE);
+                    }
+                    else if (strcmp(key, "detach_grace") == 0)
+                    {
+                        conf->detach_grace = parseint(value, true, DPT_WEB_IDE_DETACH_GRACE);
+                    }
+                    else if (strcmp(key, "detach_log_size") == 0)
+                    {
+                        conf->detach_log_size = parseint(value, true, DPT_WEB_IDE_DETACH_LOG_SIZE);
+                    }
+                    else if (strcmp(key, "detach_spill_size") == 0)
+                    {
+                        conf->detach_spill_size = parseint(value, true, DPT_WEB_IDE_DETACH_SPILL_SIZE);
+                    }
+                    else if (strcmp(key, "run_subscribers") == 0)
+                    {
+                        conf->run_subscribers = parseint(value, true, DPT_WEB_IDE_RUN_SUBSCRIBERS);
+                    }
+                    else if (strcmp(key, "workers") == 0)
+                    {
+                        conf->workers = parseint(value, true, DPT_WEB_IDE_WORKERS);
+                    }
+                    else if (strcmp(key, "io_threads") == 0)
+                    {
+                        conf->io_threads = parseint(value, true, DPT_WEB_IDE_IO_THREADS);
+                    }
+                    else if (strcmp(key, "io_uring") == 0)
+                    {
+                        conf->io_uring = value[0] == 't';
+                    }
                     else 
                     {
                         log_message(LOG_WARNING, "Unknown configuration option: '%s'\r\n", key);
@@ -226,6 +566,17 @@ bool config_parse() {
  * Free the parsed configuration data
  */
 void config_free() {
+    int i;
+    
+    for(i = 0; i < conf->mimetype_count; ++i) {
+        free(conf->mimetypes[i].extn);
+        free(conf->mimetypes[i].mime);
+        free(conf->mimetypes[i].cache_control);
+    }
+    free(conf->mimetypes);
     free(conf->html_path);
+    free(conf->bundle_path);
+    free(conf->project_path);
+    free(conf->run_cgroup);
     free(conf);
 }
\ No newline at end of file
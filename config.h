@@ -40,20 +40,124 @@
 #define DPT_WEB_IDE_FORK_ON_START       false                   // Don't daemonize by default
 #define DPT_WEB_IDE_HTML_PATH           "/www/webide"           // Base path where the IDE's HTML files are stored. 
 #define DPT_WEB_IDE_PORT                10000                   // The IDE server port. 
+#define DPT_WEB_IDE_CACHE_SIZE          2048                    // Static asset cache size in KB, 0 disables the cache
+#define DPT_WEB_IDE_SENDFILE            true                    // Send uncached files with sendfile()
+#define DPT_WEB_IDE_COMPRESS_CACHE_SIZE 1024                    // Memory for compressed file versions in KB, 0 disables them
+#define DPT_WEB_IDE_BUNDLE_PATH         ""                      // Packed HTML bundle to serve instead of html_path, empty to disable
+#define DPT_WEB_IDE_PROJECT_PATH        "/root/webide"          // Directory where uploaded project files are stored
+#define DPT_WEB_IDE_UPLOAD_MAX_SIZE     1024                    // Largest accepted upload in KB
+#define DPT_WEB_IDE_SEND_BUFF_MIN       4                       // Initial per-connection HTTP send buffer in KB
+#define DPT_WEB_IDE_SEND_BUFF_MAX       64                      // Largest per-connection HTTP send buffer in KB
+#define DPT_WEB_IDE_POOL_SIZE           256                     // Memory kept for reuse by the buffer pool in KB
+#define DPT_WEB_IDE_SCRIPT_HANDOFF      CONFIG_HANDOFF_MEMFD    // How scripts reach the interpreter: memfd, stdin or file
+#define DPT_WEB_IDE_OUTPUT_BUFF_SIZE    256                     // Interpreter output buffered per session in KB
+#define DPT_WEB_IDE_OUTPUT_POLICY       CONFIG_OVERFLOW_PAUSE   // What happens when the output buffer is full: pause, drop or kill
+#define DPT_WEB_IDE_WARM_POOL_SIZE      1                       // Idle interpreters kept waiting for a script on stdin, split over the workers, 0 disables
+#define DPT_WEB_IDE_WARM_POOL_TTL       300                     // Seconds after which an idle interpreter is replaced
+#define DPT_WEB_IDE_KILL_TIMEOUT        2000                    // Time in ms a stopped interpreter gets after SIGINT before SIGKILL
+#define DPT_WEB_IDE_MAX_RUNS            4                       // Interpreters running at once over all workers, extra runs wait, 0 for no limit
+#define DPT_WEB_IDE_RUN_CPU_LIMIT       0                       // CPU seconds per run, 0 for no limit
+#define DPT_WEB_IDE_RUN_MEMORY_LIMIT    0                       // Address space per run in KB, 0 for no limit
+#define DPT_WEB_IDE_RUN_FILE_LIMIT      0                       // Open files per run, 0 for no limit
+#define DPT_WEB_IDE_RUN_OUTPUT_LIMIT    0                       // Output per run in KB before it is stopped, 0 for no limit
+#define DPT_WEB_IDE_RUN_CGROUP          ""                      // cgroup v2 directory runs are moved to, empty to disable
+#define DPT_WEB_IDE_MAX_SCRIPT_SIZE     1024                    // Largest ide-run message (script) in KB
+#define DPT_WEB_IDE_DETACH_GRACE        0                       // Seconds a run outlives its ide-run.v1 connection, 0 disables
+#define DPT_WEB_IDE_DETACH_LOG_SIZE     64                      // Output of a detachable run kept in memory for replay in KB
+#define DPT_WEB_IDE_DETACH_SPILL_SIZE   0                       // Older output of a detachable run kept in a file in KB, 0 disables
+#define DPT_WEB_IDE_RUN_SUBSCRIBERS     0                       // Connections that may watch one ide-run.v1 run, 0 disables sharing
+#define DPT_WEB_IDE_WORKERS             1                       // Processes serving connections on the port, 1 serves all from one process
+#define DPT_WEB_IDE_IO_THREADS          2                       // Threads per process for blocking disk I/O, 0 does it on the event loop
+#define DPT_WEB_IDE_IO_URING            true                    // Read files through io_uring when the kernel allows it
 
 /* Compile time configuration options */
 #define DPT_WEB_IDE_HTTP_PATH_BUFF      256                     // Buffer size for filesystem paths
-#define DPT_WEB_IDE_HTTP_SEND_BUFF      4096                    // Buffer size for data transfers
+#define DPT_WEB_IDE_HTTP_HEADER_BUFF    512                     // Buffer size for HTTP response headers
+#define DPT_WEB_IDE_HTTP_SENDFILE_CHUNK 65536                   // Maximum bytes moved per sendfile() call
+#define DPT_WEB_IDE_HTTP_TOKEN_BUFF     256                     // Buffer size for parsed request headers
+#define DPT_WEB_IDE_GZIP_MIN_SIZE       256                     // Smallest file worth compressing on demand
+#define DPT_WEB_IDE_ETAG_BUFF           64                      // Buffer size for entity tags
+#define DPT_WEB_IDE_CACHE_CONTROL       "no-cache"              // Cache-Control for types without their own policy
+#define DPT_WEB_IDE_HTTP_MAX_RANGES     8                       // Most byte ranges served in one response
+#define DPT_WEB_IDE_HTTP_BOUNDARY_LEN   16                      // Length of multipart/byteranges boundaries
+#define DPT_WEB_IDE_HTTP_PART_BUFF      256                     // Buffer size for multipart part headers
+#define DPT_WEB_IDE_MIME_BUCKETS        64                      // Slots in the mimetype hash table, power of two
+#define DPT_WEB_IDE_MIME_EXT_LEN        16                      // Longest file extension with a mimetype
 #define DPT_WEB_IDE_DEFAULT_FILE        "index.html"            // Default file to serve
-#define DPT_WEB_IDE_WEBSOCK_TIMOUT      50                      // Libwebsockets service timeout
+#define DPT_WEB_IDE_WEBSOCK_TIMOUT      1000                    // Longest event loop wait, libwebsockets timeouts are checked this often
 #define DPT_WEB_IDE_INTERPRETER_CMD     "/usr/sbin/dpt-js"      // The used interpreter command
 #define DPT_WEB_IDE_PROC_READ_BUFF      4096                    // Buffer size for process stdout
+#define DPT_WEB_IDE_SCRIPT_FD           3                       // Descriptor the interpreter finds a memfd script on
+#define DPT_WEB_IDE_OUTPUT_FRAME        65536                   // Largest websocket frame of interpreter output
+#define DPT_WEB_IDE_OUTPUT_TICK         16                      // Time in ms output is collected before it is sent
+#define DPT_WEB_IDE_WARM_RETRY          1000                    // Delay in ms before replacing an idle interpreter that died
+#define DPT_WEB_IDE_SCRIPT_TMP          "/tmp/dptwebide-XXXXXX.js"   // Template for scripts in the file hand-off mode
+#define DPT_WEB_IDE_SPILL_TMP           "/tmp/dptwebide-XXXXXX.log"  // Template for run output that overflows to a file
+#define DPT_WEB_IDE_SPILL_MARKS         16                      // Record boundaries remembered to resume a trimmed output log
+#define DPT_WEB_IDE_CACHE_BUCKETS       256                     // Hash buckets of the static asset cache
+#define DPT_WEB_IDE_POOL_MIN_SHIFT      10                      // Smallest pooled buffer, 2^n bytes
+#define DPT_WEB_IDE_POOL_MAX_SHIFT      20                      // Largest pooled buffer, 2^n bytes
+#define DPT_WEB_IDE_IO_STACK            65536                   // Stack size of an I/O thread
+#define DPT_WEB_IDE_STALL_MS            50                      // Event loop passes taking longer than this count as stalls
+#define DPT_WEB_IDE_URING_ENTRIES       64                      // Submission queue entries of the io_uring
+
+/* The ways a submitted script can be handed to the interpreter */
+typedef enum {
+    CONFIG_HANDOFF_MEMFD = 0,       // Anonymous memory file passed as /proc/self/fd/N
+    CONFIG_HANDOFF_STDIN,           // Piped into the interpreter's stdin
+    CONFIG_HANDOFF_FILE             // Temporary file per run, fallback only
+} config_handoff;
+
+/* What to do when an interpreter produces output faster than it can be sent */
+typedef enum {
+    CONFIG_OVERFLOW_PAUSE = 0,      // Stop reading the pipe so the interpreter blocks
+    CONFIG_OVERFLOW_DROP,           // Throw output away and tell the browser how much
+    CONFIG_OVERFLOW_KILL            // Stop the interpreter
+} config_overflow;
+
+/* A mimetype added or overridden in the configuration file */
+typedef struct{
+    char* extn;
+    char* mime;
+    char* cache_control;
+} config_mimetype;
 
 /* Configuration structure */
 typedef struct{
     bool daemon;
     char* html_path;
+    char* bundle_path;
+    char* project_path;
     int port;
+    int cache_size;
+    bool sendfile;
+    int compress_cache_size;
+    int upload_max_size;
+    int send_buffer_min;
+    int send_buffer_max;
+    int pool_size;
+    config_handoff script_handoff;
+    int output_buffer_size;
+    config_overflow output_policy;
+    int warm_pool_size;
+    int warm_pool_ttl;
+    int kill_timeout;
+    int max_runs;
+    int run_cpu_limit;
+    int run_memory_limit;
+    int run_file_limit;
+    int run_output_limit;
+    char* run_cgroup;
+    int max_script_size;
+    int detach_grace;
+    int detach_log_size;
+    int detach_spill_size;
+    int run_subscribers;
+    int workers;
+    int io_threads;
+    bool io_uring;
+    config_mimetype* mimetypes;
+    int mimetype_count;
 } config;
 
 /* Application wide configuration */
@@ -28,39 +28,994 @@
  * Created on September 30, 2015, 7:29 PM
  */
 
+#define _GNU_SOURCE
+
 #include <libwebsockets.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
 
 #include "http.h"
+#include "cache.h"
+#include "bundle.h"
+#include "upload.h"
+#include "pool.h"
+#include "loop.h"
+#include "offload.h"
 #include "config.h"
 #include "mimetypes.h"
 #include "logger.h"
 
+/**
+ * Description of the response to a file request. 
+ */
+struct http_response {
+    unsigned int status;                    /* The HTTP status code */
+    const struct mimetype* type;            /* The type of the requested file */
+    const char* encoding;                   /* The content encoding or NULL */
+    const char* etag;                       /* The entity tag of the body */
+    time_t mtime;                           /* Modification time of the body */
+    size_t length;                          /* The content length */
+    const char* content_type;               /* Overrides the file type (multipart bodies) or NULL */
+    const char* content_range;              /* The Content-Range header value or NULL */
+};
+
+/**
+ * A read of the next chunk of a copied file, done on an I/O thread. 
+ */
+struct http_read {
+    struct offload_job job;                 /* The read job */
+    struct http_session* sess;              /* The session, NULL once the connection is gone */
+    struct libwebsocket* wsi;               /* The connection to wake when the data is there */
+    int fd;                                 /* The file being read */
+    ssize_t got;                            /* Bytes read and not yet sent, -1 on error */
+    bool busy;                              /* The read is in flight */
+    unsigned char* buf;                     /* Send buffer handed over by a closed connection */
+    size_t buf_size;                        /* Size of that buffer */
+};
+
+/* Type of files with an unknown extension */
+static const struct mimetype default_type = { NULL, "application/octet-stream", NULL };
+
+/* Bundle version holding each cache encoding */
+static const enum bundle_blob_kind bundle_kinds[CACHE_ENCODING_COUNT] = {
+    [CACHE_ENCODING_GZIP] = BUNDLE_BLOB_GZIP,
+    [CACHE_ENCODING_BR] = BUNDLE_BLOB_BR
+};
+
+/* Open addressed lookup table of mimetypes by extension */
+static const struct mimetype* mime_table[DPT_WEB_IDE_MIME_BUCKETS];
+static int mime_count = 0;
+
+/* Mimetypes from the configuration file */
+static struct mimetype* config_types = NULL;
+
+/* Bounds of the per-connection write size in bytes */
+static size_t chunk_min = DPT_WEB_IDE_SEND_BUFF_MIN * 1024;
+static size_t chunk_max = DPT_WEB_IDE_SEND_BUFF_MAX * 1024;
+
+/* Files may be moved to the socket with sendfile() */
+static bool zero_copy = false;
+
+/* Order in which content encodings are offered, best compression first */
+static const enum cache_encoding encoding_preference[CACHE_ENCODING_COUNT] = {
+    CACHE_ENCODING_BR, 
+    CACHE_ENCODING_GZIP
+};
+
+/**
+ * Hash a file extension, case insensitive. 
+ * @param extn the extension. 
+ * @return the 32 bit FNV-1a hash of the lowercase extension. 
+ */
+static uint32_t _http_hash_extension(const char *extn)
+{
+    uint32_t h = 2166136261u;
+    
+    while(*extn) {
+        h ^= (unsigned char) tolower((unsigned char) *extn++);
+        h *= 16777619u;
+    }
+    
+    return h;
+}
+
+/**
+ * Add a mimetype to the lookup table, replacing an earlier one with 
+ * the same extension. 
+ * @param type the mimetype to add, must stay valid. 
+ * @return true on success, false when the table is full. 
+ */
+static bool _http_add_mimetype(const struct mimetype *type)
+{
+    uint32_t i = _http_hash_extension(type->extn) & (DPT_WEB_IDE_MIME_BUCKETS - 1);
+    
+    while(mime_table[i] != NULL && strcasecmp(mime_table[i]->extn, type->extn)) {
+        i = (i + 1) & (DPT_WEB_IDE_MIME_BUCKETS - 1);
+    }
+    
+    // Keep the table at most half full so probe chains stay short
+    if(mime_table[i] == NULL) {
+        if(mime_count >= DPT_WEB_IDE_MIME_BUCKETS / 2) {
+            log_message(LOG_WARNING, "Mimetype table is full, ignoring '%s'\r\n", type->extn);
+            return false;
+        }
+        mime_count++;
+    }
+    
+    mime_table[i] = type;
+    return true;
+}
+
 /**
  * Lookup the mimetype of a file based on the file extension.
  * @param path the full filepath.
  * @return when no mimetype is assigned return the default "application/octet-stream" 
  */
-static const char* _http_get_mimetype(const char *path)
+static const struct mimetype* _http_get_mimetype(const char *path)
+{
+    const char *extn = NULL;
+    const char *p;
+    uint32_t i;
+    
+    // Find the final extension in a single pass
+    for(p = path; *p; ++p) {
+        if(*p == '.') {
+            extn = p + 1;
+        } else if(*p == '/') {
+            extn = NULL;
+        }
+    }
+    
+    if(extn == NULL || p - extn >= DPT_WEB_IDE_MIME_EXT_LEN) {
+        return &default_type;
+    }
+    
+    i = _http_hash_extension(extn) & (DPT_WEB_IDE_MIME_BUCKETS - 1);
+    while(mime_table[i] != NULL) {
+        if(!strcasecmp(mime_table[i]->extn, extn)) {
+            return mime_table[i];
+        }
+        i = (i + 1) & (DPT_WEB_IDE_MIME_BUCKETS - 1);
+    }
+
+    return &default_type;
+}
+
+/**
+ * Check if files of a mimetype benefit from compression. 
+ * @param mimetype the mimetype to check. 
+ * @return true when the content is text-like. 
+ */
+static bool _http_is_compressible(const char* mimetype)
+{
+    return strncmp(mimetype, "text/", 5) == 0 || strstr(mimetype, "javascript") || 
+           strstr(mimetype, "json") || strstr(mimetype, "xml") || strstr(mimetype, "icon") || strstr(mimetype, "wasm");
+}
+
+/**
+ * Parse the Accept-Encoding request header. 
+ * @param wsi the websocket currently used. 
+ * @return bitmask of accepted cache encodings (1 << enum cache_encoding). 
+ */
+static unsigned int _http_accepted_encodings(struct libwebsocket *wsi)
+{
+    char header[DPT_WEB_IDE_HTTP_TOKEN_BUFF];
+    unsigned int accepted = 0;
+    char *tok, *save, *params, *end;
+    int i;
+    
+    if(lws_hdr_copy(wsi, header, sizeof(header), WSI_TOKEN_HTTP_ACCEPT_ENCODING) <= 0) {
+        return 0;
+    }
+    
+    for(tok = strtok_r(header, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        while(*tok == ' ' || *tok == '\t') {
+            tok++;
+        }
+        
+        // A quality of zero means the client refuses the coding
+        if((params = strchr(tok, ';')) != NULL) {
+            *params++ = '\0';
+            while(*params == ' ' || *params == '\t') {
+                params++;
+            }
+            if(strncmp(params, "q=", 2) == 0 && strtod(params + 2, NULL) <= 0) {
+                continue;
+            }
+        }
+        
+        end = tok + strlen(tok);
+        while(end > tok && (end[-1] == ' ' || end[-1] == '\t')) {
+            *--end = '\0';
+        }
+        
+        for(i = 0; i < CACHE_ENCODING_COUNT; ++i) {
+            if(strcasecmp(tok, cache_encoding_names[i]) == 0) {
+                accepted |= 1 << i;
+            }
+        }
+    }
+    
+    return accepted;
+}
+
+/**
+ * Check if an entity tag is in an If-None-Match list. 
+ * @param list the If-None-Match header value. 
+ * @param etag the current entity tag. 
+ * @return true when the tag matches. 
+ */
+static bool _http_etag_matches(char *list, const char *etag)
+{
+    char *tok, *save, *end;
+    
+    for(tok = strtok_r(list, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        while(*tok == ' ' || *tok == '\t') {
+            tok++;
+        }
+        end = tok + strlen(tok);
+        while(end > tok && (end[-1] == ' ' || end[-1] == '\t')) {
+            *--end = '\0';
+        }
+        
+        // If-None-Match uses the weak comparison
+        if(strncmp(tok, "W/", 2) == 0) {
+            tok += 2;
+        }
+        
+        if(strcmp(tok, "*") == 0 || strcmp(tok, etag) == 0) {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+/**
+ * Check the conditional request headers against the current file. 
+ * @param wsi the websocket currently used. 
+ * @param etag the current entity tag. 
+ * @param mtime the current modification time. 
+ * @return true when the client copy is still valid. 
+ */
+static bool _http_not_modified(struct libwebsocket *wsi, const char *etag, time_t mtime)
+{
+    char header[DPT_WEB_IDE_HTTP_TOKEN_BUFF];
+    struct tm tm;
+    
+    // If-None-Match takes precedence over If-Modified-Since
+    if(lws_hdr_total_length(wsi, WSI_TOKEN_HTTP_IF_NONE_MATCH)) {
+        return lws_hdr_copy(wsi, header, sizeof(header), WSI_TOKEN_HTTP_IF_NONE_MATCH) > 0 && _http_etag_matches(header, etag);
+    }
+    
+    if(lws_hdr_copy(wsi, header, sizeof(header), WSI_TOKEN_HTTP_IF_MODIFIED_SINCE) > 0) {
+        memset(&tm, 0, sizeof(tm));
+        if(strptime(header, "%a, %d %b %Y %H:%M:%S GMT", &tm) != NULL) {
+            return mtime <= timegm(&tm);
+        }
+    }
+    
+    return false;
+}
+
+/**
+ * Send the response headers for a file transfer. 
+ * @param context the context of the request. 
+ * @param wsi the websocket currently used. 
+ * @param resp the response to send the headers for. 
+ * @return 0 on success or -1 on error. 
+ */
+static int _http_send_headers(struct libwebsocket_context *context, struct libwebsocket *wsi, const struct http_response *resp)
+{
+    unsigned char headers[LWS_SEND_BUFFER_PRE_PADDING + DPT_WEB_IDE_HTTP_HEADER_BUFF];
+    unsigned char *start = headers + LWS_SEND_BUFFER_PRE_PADDING;
+    unsigned char *end = headers + sizeof(headers);
+    unsigned char *p = start;
+    const char *cache_control = resp->type->cache_control ? resp->type->cache_control : DPT_WEB_IDE_CACHE_CONTROL;
+    char date[32];
+    struct tm tm;
+    
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", gmtime_r(&resp->mtime, &tm));
+    
+    if(lws_add_http_header_status(context, wsi, resp->status, &p, end) ||
+       (resp->encoding && lws_add_http_header_by_token(context, wsi, WSI_TOKEN_HTTP_CONTENT_ENCODING, (const unsigned char*) resp->encoding, strlen(resp->encoding), &p, end)) ||
+       lws_add_http_header_by_token(context, wsi, WSI_TOKEN_HTTP_VARY, (const unsigned char*) "Accept-Encoding", 15, &p, end) ||
+       lws_add_http_header_by_token(context, wsi, WSI_TOKEN_HTTP_ETAG, (const unsigned char*) resp->etag, strlen(resp->etag), &p, end) ||
+       lws_add_http_header_by_token(context, wsi, WSI_TOKEN_HTTP_LAST_MODIFIED, (const unsigned char*) date, strlen(date), &p, end) ||
+       lws_add_http_header_by_token(context, wsi, WSI_TOKEN_HTTP_CACHE_CONTROL, (const unsigned char*) cache_control, strlen(cache_control), &p, end)) {
+        goto overflow;
+    }
+    
+    // A 304 carries no body, only the validators
+    if(resp->status != HTTP_STATUS_NOT_MODIFIED) {
+        const char *type = resp->content_type ? resp->content_type : resp->type->mime;
+        
+        if(lws_add_http_header_by_token(context, wsi, WSI_TOKEN_HTTP_CONTENT_TYPE, (const unsigned char*) type, strlen(type), &p, end) ||
+           lws_add_http_header_by_token(context, wsi, WSI_TOKEN_HTTP_ACCEPT_RANGES, (const unsigned char*) "bytes", 5, &p, end) ||
+           (resp->content_range && lws_add_http_header_by_token(context, wsi, WSI_TOKEN_HTTP_CONTENT_RANGE, (const unsigned char*) resp->content_range, strlen(resp->content_range), &p, end)) ||
+           lws_add_http_header_content_length(context, wsi, resp->length, &p, end)) {
+            goto overflow;
+        }
+    }
+    
+    if(lws_finalize_http_header(context, wsi, &p, end)) {
+        goto overflow;
+    }
+    
+    if(libwebsocket_write(wsi, start, p - start, LWS_WRITE_HTTP) != (p - start)) {
+        return -1;
+    }
+    
+    return 0;
+    
+overflow:
+    log_message(LOG_ERROR, "HTTP response headers do not fit in the header buffer\r\n");
+    return -1;
+}
+
+/**
+ * Drop the transfer state of a session. 
+ * @param sess the HTTP session data. 
+ */
+static void _http_session_reset(struct http_session *sess)
+{
+    if(sess->read != NULL && sess->read->busy) {
+        // The I/O thread still uses the file and the buffer, its completion gives them back
+        sess->read->sess = NULL;
+        sess->read->buf = sess->buf;
+        sess->read->buf_size = sess->buf_size;
+        sess->buf = NULL;
+    } else if(sess->transfer == HTTP_TRANSFER_READ || sess->transfer == HTTP_TRANSFER_SENDFILE) {
+        close(sess->fd);
+        free(sess->read);
+    }
+    sess->read = NULL;
+    
+    cache_release(sess->entry);
+    pool_release(sess->buf, sess->buf_size);
+    sess->buf = NULL;
+    sess->buf_size = 0;
+    sess->transfer = HTTP_TRANSFER_NONE;
+    sess->entry = NULL;
+    sess->data = NULL;
+    sess->offset = 0;
+    sess->size = 0;
+    sess->total = 0;
+    sess->range_count = 0;
+    sess->range_index = 0;
+}
+
+/**
+ * Parse the Range request header against the file being sent. 
+ * @param wsi the websocket currently used. 
+ * @param total the size of the complete file. 
+ * @param ranges filled with the satisfiable ranges. 
+ * @return the number of satisfiable ranges, 0 when none can be satisfied or 
+ * -1 when the whole file must be sent (no, invalid or to many ranges). 
+ */
+static int _http_parse_ranges(struct libwebsocket *wsi, size_t total, struct http_range *ranges)
+{
+    char header[DPT_WEB_IDE_HTTP_TOKEN_BUFF];
+    char *tok, *save, *dash, *endp;
+    unsigned long long start, end;
+    int count = 0;
+    
+    if(lws_hdr_copy(wsi, header, sizeof(header), WSI_TOKEN_HTTP_RANGE) <= 0 || strncmp(header, "bytes=", 6)) {
+        return -1;
+    }
+    
+    for(tok = strtok_r(header + 6, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        while(*tok == ' ' || *tok == '\t') {
+            tok++;
+        }
+        if((dash = strchr(tok, '-')) == NULL) {
+            return -1;
+        }
+        
+        if(dash == tok) {
+            // Suffix range: the last N bytes
+            end = strtoull(dash + 1, &endp, 10);
+            if(endp == dash + 1 || (*endp && *endp != ' ')) {
+                return -1;
+            }
+            if(end == 0 || total == 0) {
+                continue;
+            }
+            start = end >= total ? 0 : total - end;
+            end = total - 1;
+        } else {
+            start = strtoull(tok, &endp, 10);
+            if(endp != dash) {
+                return -1;
+            }
+            
+            end = total - 1;
+            if(dash[1] != '\0' && dash[1] != ' ') {
+                end = strtoull(dash + 1, &endp, 10);
+                if((*endp && *endp != ' ') || end < start) {
+                    return -1;
+                }
+            }
+            
+            if(start >= total) {
+                continue;
+            }
+            if(end >= total) {
+                end = total - 1;
+            }
+        }
+        
+        // Clients asking for lots of tiny pieces just get the whole file
+        if(count == DPT_WEB_IDE_HTTP_MAX_RANGES) {
+            return -1;
+        }
+        ranges[count].start = start;
+        ranges[count].end = end;
+        count++;
+    }
+    
+    return count;
+}
+
+/**
+ * Check the If-Range request header, ranges are only served when the 
+ * client still has the current version of the file. 
+ * @param wsi the websocket currently used. 
+ * @param etag the current entity tag. 
+ * @param mtime the current modification time. 
+ * @return true when ranges may be served. 
+ */
+static bool _http_if_range(struct libwebsocket *wsi, const char *etag, time_t mtime)
+{
+    char header[DPT_WEB_IDE_HTTP_TOKEN_BUFF];
+    struct tm tm;
+    
+    if(lws_hdr_total_length(wsi, WSI_TOKEN_HTTP_IF_RANGE) == 0) {
+        return true;
+    }
+    if(lws_hdr_copy(wsi, header, sizeof(header), WSI_TOKEN_HTTP_IF_RANGE) <= 0) {
+        return false;
+    }
+    
+    if(header[0] == '"') {
+        return strcmp(header, etag) == 0;
+    }
+    
+    memset(&tm, 0, sizeof(tm));
+    return strptime(header, "%a, %d %b %Y %H:%M:%S GMT", &tm) != NULL && timegm(&tm) == mtime;
+}
+
+/**
+ * Format the header that introduces a part of a multipart/byteranges body. 
+ * @param buf the buffer to write to, at least DPT_WEB_IDE_HTTP_PART_BUFF bytes. 
+ * @param sess the HTTP session data. 
+ * @param index the part to format, range_count formats the closing boundary. 
+ * @return the length of the header. 
+ */
+static int _http_format_part(char *buf, const struct http_session *sess, int index)
+{
+    if(index == sess->range_count) {
+        return snprintf(buf, DPT_WEB_IDE_HTTP_PART_BUFF, "\r\n--%s--\r\n", sess->boundary);
+    }
+    
+    return snprintf(buf, DPT_WEB_IDE_HTTP_PART_BUFF, "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %lu-%lu/%lu\r\n\r\n", 
+            sess->boundary, sess->part_type, (unsigned long) sess->ranges[index].start, 
+            (unsigned long) sess->ranges[index].end, (unsigned long) sess->total);
+}
+
+/**
+ * Prepare the session for sending the requested ranges of a file. 
+ * @param sess the HTTP session data, holding the file to send. 
+ * @param resp the response to fill in. 
+ * @param count the number of ranges parsed into the session. 
+ * @param content_range buffer for the Content-Range header of a single range. 
+ * @param content_type buffer for the multipart content type. 
+ */
+static void _http_setup_ranges(struct http_session *sess, struct http_response *resp, int count, char *content_range, char *content_type)
+{
+    char part[DPT_WEB_IDE_HTTP_PART_BUFF];
+    int i;
+    
+    resp->status = HTTP_STATUS_PARTIAL_CONTENT;
+    
+    if(count == 1) {
+        sess->offset = sess->ranges[0].start;
+        sess->size = sess->ranges[0].end + 1;
+        resp->length = sess->size - sess->offset;
+        snprintf(content_range, DPT_WEB_IDE_HTTP_PART_BUFF, "bytes %lu-%lu/%lu", (unsigned long) sess->ranges[0].start, 
+                (unsigned long) sess->ranges[0].end, (unsigned long) sess->total);
+        resp->content_range = content_range;
+        return;
+    }
+    
+    // Every part is preceded by its own header, the first one goes out on the first write
+    sess->range_count = count;
+    sess->range_index = -1;
+    sess->part_type = resp->type->mime;
+    sess->offset = sess->size = 0;
+    snprintf(sess->boundary, sizeof(sess->boundary), "%08lx%08lx", (unsigned long) random(), (unsigned long) random());
+    
+    resp->length = 0;
+    for(i = 0; i <= count; ++i) {
+        resp->length += _http_format_part(part, sess, i);
+        if(i < count) {
+            resp->length += sess->ranges[i].end - sess->ranges[i].start + 1;
+        }
+    }
+    
+    snprintf(content_type, DPT_WEB_IDE_HTTP_PART_BUFF, "multipart/byteranges; boundary=%s", sess->boundary);
+    resp->content_type = content_type;
+}
+
+/**
+ * Start the next part of a multipart/byteranges body once the current 
+ * one is sent. 
+ * @param context the context of the request. 
+ * @param wsi the websocket currently used. 
+ * @param sess the HTTP session data. 
+ * @return 0 when more data follows, 1 when the body is complete or -1 on error. 
+ */
+static int _http_next_part(struct libwebsocket_context *context, struct libwebsocket *wsi, struct http_session *sess)
+{
+    char part[LWS_SEND_BUFFER_PRE_PADDING + DPT_WEB_IDE_HTTP_PART_BUFF];
+    int n;
+    
+    if(sess->range_index >= sess->range_count) {
+        return 1;
+    }
+    
+    sess->range_index++;
+    n = _http_format_part(part + LWS_SEND_BUFFER_PRE_PADDING, sess, sess->range_index);
+    
+    if(sess->range_index < sess->range_count) {
+        sess->offset = sess->ranges[sess->range_index].start;
+        sess->size = sess->ranges[sess->range_index].end + 1;
+    } else {
+        // Closing boundary, nothing left to send from the file
+        sess->offset = sess->size;
+    }
+    
+    if(libwebsocket_write(wsi, (unsigned char*) part + LWS_SEND_BUFFER_PRE_PADDING, n, LWS_WRITE_HTTP) != n) {
+        return -1;
+    }
+    
+    libwebsocket_callback_on_writable(context, wsi);
+    return 0;
+}
+
+/**
+ * Open a regular file for transfer. 
+ * @param path the full filepath. 
+ * @param size filled with the file size. 
+ * @return the file descriptor or -1 when the file can't be served. 
+ */
+static int _http_open_file(const char *path, size_t *size)
+{
+    struct stat st;
+    int fd;
+    
+    if((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+        return -1;
+    }
+    
+    if(fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    
+    *size = st.st_size;
+    return fd;
+}
+
+/**
+ * Serve a file from memory, swapping in an encoded version when the 
+ * client accepts one. 
+ * @param sess the HTTP session data, holding the cached original. 
+ * @param accepted the accepted cache encodings. 
+ * @return the content encoding name or NULL when sending the original. 
+ */
+static const char* _http_pick_cached_variant(struct http_session *sess, unsigned int accepted)
+{
+    struct cache_entry *v;
+    int i, enc;
+    
+    for(i = 0; i < CACHE_ENCODING_COUNT; ++i) {
+        enc = encoding_preference[i];
+        if(!(accepted & (1 << enc))) {
+            continue;
+        }
+        
+        if((v = cache_get_variant(sess->entry, enc, _http_is_compressible(sess->entry->mimetype))) != NULL) {
+            cache_release(sess->entry);
+            sess->entry = v;
+            return cache_encoding_names[enc];
+        }
+    }
+    
+    return NULL;
+}
+
+/**
+ * Serve a file from the bundle, picking a stored encoded version when 
+ * the client accepts one. 
+ * @param sess the HTTP session data. 
+ * @param rec the bundle index record of the file. 
+ * @param accepted the accepted cache encodings. 
+ * @param etag filled with the entity tag of the picked version. 
+ * @return the content encoding name or NULL when sending the original. 
+ */
+static const char* _http_pick_bundle_blob(struct http_session *sess, const struct bundle_record *rec, unsigned int accepted, char *etag)
+{
+    const char *tag;
+    int i, enc;
+    
+    for(i = 0; i < CACHE_ENCODING_COUNT; ++i) {
+        enc = encoding_preference[i];
+        if((accepted & (1 << enc)) && (sess->data = bundle_get_blob(rec, bundle_kinds[enc], &sess->size, &tag)) != NULL) {
+            strcpy(etag, tag);
+            return cache_encoding_names[enc];
+        }
+    }
+    
+    sess->data = bundle_get_blob(rec, BUNDLE_BLOB_IDENTITY, &sess->size, &tag);
+    strcpy(etag, tag);
+    return NULL;
+}
+
+/**
+ * Find a file on disk, preferring a precompressed sibling when the 
+ * client accepts one. 
+ * @param path the full filepath. 
+ * @param accepted the accepted cache encodings. 
+ * @param found filled with the path of the file to send. 
+ * @param st filled with the status of the file to send. 
+ * @return the content encoding name or NULL when sending the original. 
+ */
+static const char* _http_find_variant(const char *path, unsigned int accepted, char *found, struct stat *st)
+{
+    int i, enc;
+    
+    for(i = 0; i < CACHE_ENCODING_COUNT; ++i) {
+        enc = encoding_preference[i];
+        if(!(accepted & (1 << enc)) || snprintf(found, DPT_WEB_IDE_HTTP_PATH_BUFF, "%s%s", path, cache_encoding_suffixes[enc]) >= DPT_WEB_IDE_HTTP_PATH_BUFF) {
+            continue;
+        }
+        
+        if(stat(found, st) == 0 && S_ISREG(st->st_mode)) {
+            return cache_encoding_names[enc];
+        }
+    }
+    
+    strcpy(found, path);
+    if(stat(found, st)) {
+        st->st_mode = 0;
+    }
+    return NULL;
+}
+
+/**
+ * Adapt the write size of a connection after a writeable callback. It 
+ * doubles when the client drained more than a full write without being 
+ * limited by its write allowance and halves when the socket could not 
+ * take a write. 
+ * @param sess the HTTP session data. 
+ * @param drained the bytes written during the callback. 
+ * @param limited true when the write allowance or the socket cut a write short. 
+ */
+static void _http_adapt_chunk(struct http_session *sess, size_t drained, bool limited)
+{
+    if(limited) {
+        sess->chunk /= 2;
+    } else if(drained >= sess->chunk) {
+        sess->chunk *= 2;
+    }
+    
+    if(sess->chunk < chunk_min) {
+        sess->chunk = chunk_min;
+    }
+    if(sess->chunk > chunk_max) {
+        sess->chunk = chunk_max;
+    }
+}
+
+/**
+ * Move the next part of a file to the socket with sendfile(). Falls
+ * back to copying when the kernel can't sendfile this file. 
+ * @param context the context of the request. 
+ * @param wsi the websocket currently used. 
+ * @param sess the HTTP session data. 
+ * @return 0 when more data follows, 1 when the range is sent or -1 on error. 
+ */
+static int _http_write_sendfile(struct libwebsocket_context *context, struct libwebsocket *wsi, struct http_session *sess)
+{
+    off_t off = sess->offset;
+    size_t n = sess->size - sess->offset;
+    ssize_t m;
+    
+    // Data queued inside libwebsockets (the headers) must reach the socket first
+    if(lws_partial_buffered(wsi)) {
+        libwebsocket_callback_on_writable(context, wsi);
+        return 0;
+    }
+    
+    if(n > DPT_WEB_IDE_HTTP_SENDFILE_CHUNK) {
+        n = DPT_WEB_IDE_HTTP_SENDFILE_CHUNK;
+    }
+    
+    if(n > 0) {
+        m = sendfile(libwebsocket_get_socket_fd(wsi), sess->fd, &off, n);
+        if(m < 0) {
+            if(errno == EAGAIN || errno == EINTR) {
+                libwebsocket_callback_on_writable(context, wsi);
+                return 0;
+            }
+            
+            if(errno == EINVAL || errno == ENOSYS) {
+                log_message(LOG_WARNING, "sendfile() not supported for this file, falling back to copying\r\n");
+                sess->transfer = HTTP_TRANSFER_READ;
+                libwebsocket_callback_on_writable(context, wsi);
+                return 0;
+            }
+            
+            log_message(LOG_ERROR, "sendfile() failed: %s\r\n", strerror(errno));
+            return -1;
+        }
+        
+        // The file shrunk while sending, the promised length can't be met
+        if(m == 0) {
+            return -1;
+        }
+        
+        libwebsocket_set_timeout(wsi, PENDING_TIMEOUT_HTTP_CONTENT, 5);
+        sess->offset = off;
+    }
+    
+    if(sess->offset < sess->size) {
+        libwebsocket_callback_on_writable(context, wsi);
+        return 0;
+    }
+    
+    return 1;
+}
+
+/**
+ * Send the next part of a file held in memory. 
+ * @param context the context of the request. 
+ * @param wsi the websocket currently used. 
+ * @param sess the HTTP session data. 
+ * @return 0 when more data follows, 1 when the range is sent or -1 on error. 
+ */
+static int _http_write_memory(struct libwebsocket_context *context, struct libwebsocket *wsi, struct http_session *sess)
+{
+    size_t drained = 0;
+    bool limited = false;
+    int n, m;
+    
+    while(sess->offset < sess->size && !lws_send_pipe_choked(wsi)) {
+        n = sess->size - sess->offset;
+        if((size_t) n > sess->chunk) {
+            n = sess->chunk;
+        }
+        
+        m = lws_get_peer_write_allowance(wsi);
+        if(m == 0) {
+            limited = true;
+            break;
+        }
+        if(m != -1 && m < n) {
+            n = m;
+            limited = true;
+        }
+        
+        // Plain HTTP writes don't use the pre-padding, send straight from memory
+        m = libwebsocket_write(wsi, (unsigned char*) sess->data + sess->offset, n, LWS_WRITE_HTTP);
+        if(m < 0) {
+            return -1;
+        }
+        if(m) {
+            libwebsocket_set_timeout(wsi, PENDING_TIMEOUT_HTTP_CONTENT, 5);
+        }
+        sess->offset += m;
+        drained += m;
+        
+        if(lws_partial_buffered(wsi)) {
+            limited = true;
+            break;
+        }
+    }
+    _http_adapt_chunk(sess, drained, limited);
+    
+    if(sess->offset < sess->size || lws_partial_buffered(wsi)) {
+        libwebsocket_callback_on_writable(context, wsi);
+        return 0;
+    }
+    
+    return 1;
+}
+
+/**
+ * Completion of a chunk read, runs on the event loop. 
+ * @param context the websocket context. 
+ * @param data the read. 
+ */
+static void _http_chunk_read(struct libwebsocket_context* context, void* data)
+{
+    struct http_read *rd = (struct http_read*) data;
+    
+    rd->busy = false;
+    
+    // A file that shrunk while sending can't meet the promised length either
+    rd->got = rd->job.result > 0 ? rd->job.result : -1;
+    
+    // The connection is gone, the read owns the file and the buffer now
+    if(rd->sess == NULL) {
+        close(rd->fd);
+        pool_release(rd->buf, rd->buf_size);
+        free(rd);
+        return;
+    }
+    
+    if(context != NULL) {
+        libwebsocket_callback_on_writable(context, rd->wsi);
+    }
+}
+
+/**
+ * Copy the next part of a file through the send buffer. The file is read 
+ * through io_uring or on an I/O thread, the connection is woken up once 
+ * the data is there. 
+ * @param context the context of the request. 
+ * @param wsi the websocket currently used. 
+ * @param sess the HTTP session data. 
+ * @return 0 when more data follows, 1 when the range is sent or -1 on error. 
+ */
+static int _http_write_copy(struct libwebsocket_context *context, struct libwebsocket *wsi, struct http_session *sess)
 {
-    const struct mimetype *m = &mime_types[0];
-    const char *e;
+    struct http_read *rd = sess->read;
+    size_t n;
+    int m;
+    
+    // The completion of the read in flight asks for another callback
+    if(rd != NULL && rd->busy) {
+        return 0;
+    }
+    
+    // Send what the last read brought in, an unsent remainder is read again
+    if(rd != NULL && rd->got != 0) {
+        if(rd->got < 0) {
+            log_message(LOG_ERROR, "Problem with reading from HTTP connection\r\n");
+            return -1;
+        }
+        
+        n = rd->got;
+        rd->got = 0;
+        m = libwebsocket_write(wsi, sess->buf + LWS_SEND_BUFFER_PRE_PADDING, n, LWS_WRITE_HTTP);
+        if(m < 0) {
+            return -1;
+        }
+        if(m) {
+            libwebsocket_set_timeout(wsi, PENDING_TIMEOUT_HTTP_CONTENT, 5);
+        }
+        sess->offset += m;
+        _http_adapt_chunk(sess, m, (size_t) m < n || lws_partial_buffered(wsi));
+    }
+    
+    if(sess->offset >= sess->size && !lws_partial_buffered(wsi)) {
+        return 1;
+    }
+    
+    // Data queued inside libwebsockets must reach the socket first
+    if(sess->offset >= sess->size || lws_partial_buffered(wsi) || lws_send_pipe_choked(wsi)) {
+        libwebsocket_callback_on_writable(context, wsi);
+        return 0;
+    }
+    
+    n = sess->chunk;
+    m = lws_get_peer_write_allowance(wsi);
+    if(m == 0) {
+        _http_adapt_chunk(sess, 0, true);
+        libwebsocket_callback_on_writable(context, wsi);
+        return 0;
+    }
+    if(m != -1 && (size_t) m < n) {
+        n = m;
+    }
+    if(n > sess->size - sess->offset) {
+        n = sess->size - sess->offset;
+    }
+    
+    // Take a bigger buffer from the pool when the write size grew past it
+    if(sess->buf_size < LWS_SEND_BUFFER_PRE_PADDING + sess->chunk) {
+        pool_release(sess->buf, sess->buf_size);
+        if((sess->buf = pool_alloc(LWS_SEND_BUFFER_PRE_PADDING + sess->chunk, &sess->buf_size)) == NULL) {
+            sess->buf_size = 0;
+            log_message(LOG_ERROR, "Could not allocate HTTP send buffer\r\n");
+            return -1;
+        }
+    }
+    
+    if(rd == NULL && (rd = sess->read = calloc(1, sizeof(struct http_read))) == NULL) {
+        log_message(LOG_ERROR, "Could not allocate HTTP read\r\n");
+        return -1;
+    }
+    
+    // Read the next chunk without blocking the event loop
+    rd->sess = sess;
+    rd->wsi = wsi;
+    rd->fd = sess->fd;
+    rd->busy = true;
+    offload_read(&rd->job, sess->fd, sess->buf + LWS_SEND_BUFFER_PRE_PADDING, n, sess->offset, _http_chunk_read, rd);
+    return 0;
+}
 
-    while (m->extn) {
-        e = &path[strlen(path) - 1];
+/**
+ * Completion of a stored upload, sends the reply on the next write callback. 
+ * @param context the websocket context, NULL during shutdown. 
+ * @param stored true when the upload is stored. 
+ * @param data the HTTP session data. 
+ */
+static void _http_upload_stored(struct libwebsocket_context* context, bool stored, void* data)
+{
+    struct http_session *sess = (struct http_session*) data;
+    
+    sess->upload = NULL;
+    sess->status = stored ? HTTP_STATUS_OK : HTTP_STATUS_INTERNAL_SERVER_ERROR;
+    if(context != NULL) {
+        libwebsocket_callback_on_writable(context, sess->wsi);
+    }
+}
 
-        while (e >= path) {
-            if ((*e == '.' || *e == '/') && !strcasecmp(&e[1], m->extn))
-                return m->mime;
-            --e;
+/**
+ * Initialize the HTTP file server. 
+ * @param use_zero_copy true when files may be sent with sendfile(), only 
+ * allowed when the connections are not encrypted. 
+ */
+void http_init(bool use_zero_copy)
+{
+    const struct mimetype *m;
+    int i;
+    
+    zero_copy = use_zero_copy;
+    
+    /* Per-connection write sizes, kept within what the buffer pool can hold */
+    if(conf->send_buffer_min > 0) {
+        chunk_min = (size_t) conf->send_buffer_min * 1024;
+    }
+    if(conf->send_buffer_max > 0) {
+        chunk_max = (size_t) conf->send_buffer_max * 1024;
+    }
+    if(chunk_max > ((size_t) 1 << DPT_WEB_IDE_POOL_MAX_SHIFT) - LWS_SEND_BUFFER_PRE_PADDING) {
+        chunk_max = ((size_t) 1 << DPT_WEB_IDE_POOL_MAX_SHIFT) - LWS_SEND_BUFFER_PRE_PADDING;
+    }
+    if(chunk_min > chunk_max) {
+        chunk_min = chunk_max;
+    }
+    
+    /* Build the mimetype table, configured types override the built in ones */
+    for(m = &mime_types[0]; m->extn; ++m) {
+        _http_add_mimetype(m);
+    }
+    
+    if(conf->mimetype_count > 0 && (config_types = calloc(conf->mimetype_count, sizeof(struct mimetype))) != NULL) {
+        for(i = 0; i < conf->mimetype_count; ++i) {
+            config_types[i].extn = conf->mimetypes[i].extn;
+            config_types[i].mime = conf->mimetypes[i].mime;
+            config_types[i].cache_control = conf->mimetypes[i].cache_control;
+            _http_add_mimetype(&config_types[i]);
         }
-        ++m;
     }
 
-    return "application/octet-stream";
+    log_message(LOG_INFO, "HTTP file transfers use %s\r\n", zero_copy ? "sendfile()" : "read()/write()");
 }
 
 /**
@@ -77,9 +1032,17 @@ int http_callback(struct libwebsocket_context *context, struct libwebsocket *wsi
 {
     char path_buffer[DPT_WEB_IDE_HTTP_PATH_BUFF];                                   /* Buffer to store the real filepath in */
     const char* request = (const char*) in;                                         /* The request part of the URL */
-    static unsigned char buffer[DPT_WEB_IDE_HTTP_SEND_BUFF];                        /* Data transfer buffer */
     struct http_session *sess = (struct http_session*) user;                        /* The HTTP session data */
-    int n, m;                                                                       /* Working variables */                               
+    char file_path[DPT_WEB_IDE_HTTP_PATH_BUFF];                                     /* The file on disk that will be sent */
+    char etag[DPT_WEB_IDE_ETAG_BUFF];                                               /* The entity tag of the response */
+    struct http_response resp;                                                      /* The response being prepared */
+    unsigned int accepted;                                                          /* The content encodings the client accepts */
+    struct stat st;                                                                 /* Status of the file on disk */
+    const struct bundle_record *rec;                                                /* The file in the bundle */
+    char content_range[DPT_WEB_IDE_HTTP_PART_BUFF];                                 /* Content-Range of a partial response */
+    char content_type[DPT_WEB_IDE_HTTP_PART_BUFF];                                  /* Content-Type of a multipart response */
+    unsigned int status;                                                            /* Status code of a refused upload */
+    int n;                                                                          /* Working variables */                               
     
     switch(reason) {
         case LWS_CALLBACK_HTTP:
@@ -90,8 +1053,20 @@ int http_callback(struct libwebsocket_context *context, struct libwebsocket *wsi
                 goto finish;
             }
             
-            /* Proceed to accept data if this is a POST request */
+            /* Stream the body of a POST request into the project directory */
             if(lws_hdr_total_length(wsi, WSI_TOKEN_POST_URI)) {
+                if(lws_hdr_copy(wsi, content_range, sizeof(content_range), WSI_TOKEN_HTTP_CONTENT_LENGTH) <= 0) {
+                    libwebsockets_return_http_status(context, wsi, HTTP_STATUS_LENGTH_REQUIRED, NULL);
+                    return -1;
+                }
+                
+                /* The body is never read after a refusal, so drop the connection */
+                upload_abort(sess->upload);
+                sess->upload = upload_begin(conf->project_path, request, strtoul(content_range, NULL, 10), (size_t) conf->upload_max_size * 1024, &status);
+                if(sess->upload == NULL) {
+                    libwebsockets_return_http_status(context, wsi, status, NULL);
+                    return -1;
+                }
                 return 0;
             }
             
@@ -107,7 +1082,7 @@ int http_callback(struct libwebsocket_context *context, struct libwebsocket *wsi
                 }
                 
                 /* Append correct filename */
-                if(request[0] == '/') {
+                if(request[0] != '/') {
                     strncat(path_buffer, "/", DPT_WEB_IDE_HTTP_PATH_BUFF - strlen(path_buffer));
                 }
                 strncat(path_buffer, request, DPT_WEB_IDE_HTTP_PATH_BUFF - strlen(path_buffer));
@@ -118,87 +1093,167 @@ int http_callback(struct libwebsocket_context *context, struct libwebsocket *wsi
             path_buffer[DPT_WEB_IDE_HTTP_PATH_BUFF - 1] = '\0';
             
             /* Lookup the mimetype of the file */
-            const char* mimetype = _http_get_mimetype(path_buffer);
+            memset(&resp, 0, sizeof(resp));
+            resp.status = HTTP_STATUS_OK;
+            resp.type = _http_get_mimetype(path_buffer);
+            resp.etag = etag;
+            
+            /* Compressed versions are only sent to clients that ask for them */
+            accepted = _http_accepted_encodings(wsi);
+            
+            /* Serve from the bundle or the cache, otherwise look on disk without opening */
+            _http_session_reset(sess);
+            if(bundle_enabled()) {
+                if((rec = bundle_find(path_buffer + strlen(conf->html_path))) == NULL) {
+                    libwebsockets_return_http_status(context, wsi, HTTP_STATUS_NOT_FOUND, NULL);
+                    goto finish;
+                }
+                resp.encoding = _http_pick_bundle_blob(sess, rec, accepted, etag);
+                resp.mtime = bundle_get_mtime(rec);
+                sess->transfer = HTTP_TRANSFER_MEMORY;
+            } else if((sess->entry = cache_get(path_buffer, resp.type->mime)) != NULL) {
+                resp.encoding = _http_pick_cached_variant(sess, accepted);
+                resp.mtime = sess->entry->mtime;
+                strcpy(etag, sess->entry->etag);
+                sess->transfer = HTTP_TRANSFER_MEMORY;
+                sess->data = sess->entry->data;
+                sess->size = sess->entry->size;
+            } else {
+                resp.encoding = _http_find_variant(path_buffer, accepted, file_path, &st);
+                if(!S_ISREG(st.st_mode)) {
+                    libwebsockets_return_http_status(context, wsi, HTTP_STATUS_NOT_FOUND, NULL);
+                    goto finish;
+                }
+                resp.mtime = st.st_mtime;
+                cache_format_etag(etag, &st);
+            }
+            
+            /* The client copy is still valid, answer without a body */
+            if(_http_not_modified(wsi, etag, resp.mtime)) {
+                _http_session_reset(sess);
+                resp.status = HTTP_STATUS_NOT_MODIFIED;
+                if(_http_send_headers(context, wsi, &resp)) {
+                    return -1;
+                }
+                goto finish;
+            }
             
-            // Serve the file asynchronously
-            n = libwebsockets_serve_http_file(context, wsi, path_buffer, mimetype, NULL, 0);
-            if (n < 0 || ((n > 0) && lws_http_transaction_completed(wsi))) {
-                log_message(LOG_ERROR, "Can't reuse the connection, close socket\r\n");
+            if(sess->transfer == HTTP_TRANSFER_NONE) {
+                if((sess->fd = _http_open_file(file_path, &sess->size)) < 0) {
+                    libwebsockets_return_http_status(context, wsi, HTTP_STATUS_NOT_FOUND, NULL);
+                    goto finish;
+                }
+                sess->transfer = zero_copy ? HTTP_TRANSFER_SENDFILE : HTTP_TRANSFER_READ;
+            }
+            sess->total = sess->size;
+            resp.length = sess->size;
+            if(sess->chunk == 0) {
+                sess->chunk = chunk_min;
+            }
+            
+            /* Byte ranges of the current version only */
+            n = _http_if_range(wsi, etag, resp.mtime) ? _http_parse_ranges(wsi, sess->total, sess->ranges) : -1;
+            if(n == 0) {
+                snprintf(content_range, sizeof(content_range), "bytes */%lu", (unsigned long) sess->total);
+                _http_session_reset(sess);
+                resp.status = HTTP_STATUS_REQ_RANGE_NOT_SATISFIABLE;
+                resp.content_range = content_range;
+                resp.length = 0;
+                if(_http_send_headers(context, wsi, &resp)) {
+                    return -1;
+                }
+                goto finish;
+            }
+            if(n > 0) {
+                _http_setup_ranges(sess, &resp, n, content_range, content_type);
+            }
+            
+            // Send the headers and stream the body asynchronously
+            if(_http_send_headers(context, wsi, &resp)) {
+                _http_session_reset(sess);
                 return -1;
             }
-    
+            libwebsocket_callback_on_writable(context, wsi);
             break;
             
         case LWS_CALLBACK_HTTP_BODY:
-            strncpy(path_buffer, request, 20);
-            path_buffer[len < 20 ? len : 20] = '\0';
-            
-            lwsl_notice("LWS_CALLBACK_HTTP_BODY: %s... len %d\n", (const char*) path_buffer, (int) len);
+            // Write each chunk to disk as it arrives
+            if(sess->upload != NULL && !upload_write(sess->upload, in, len, &status)) {
+                upload_abort(sess->upload);
+                sess->upload = NULL;
+                libwebsockets_return_http_status(context, wsi, status, NULL);
+                return -1;
+            }
             break;
             
         case LWS_CALLBACK_HTTP_BODY_COMPLETION:
-            lwsl_notice("LWS_CALLBACK_HTTP_BODY_COMPLETION\n");
-            libwebsockets_return_http_status(context, wsi, HTTP_STATUS_OK, NULL);
-            goto finish;
+            if(sess->upload == NULL) {
+                libwebsockets_return_http_status(context, wsi, HTTP_STATUS_BAD_REQUEST, NULL);
+                goto finish;
+            }
+            
+            // Reply once the upload is on disk, the event loop goes on meanwhile
+            sess->wsi = wsi;
+            upload_finish(sess->upload, _http_upload_stored, sess);
+            break;
             
         case LWS_CALLBACK_HTTP_FILE_COMPLETION:
             // Close the connection after the body is complete
             goto finish;
             
+        case LWS_CALLBACK_CLOSED_HTTP:
+            // Give back the file and drop partial uploads when the client went away mid-transfer
+            _http_session_reset(sess);
+            upload_abort(sess->upload);
+            sess->upload = NULL;
+            break;
+            
         case LWS_CALLBACK_HTTP_WRITEABLE:
-            // Proceed with transmitting data
-            do {
-                n = DPT_WEB_IDE_HTTP_SEND_BUFF - LWS_SEND_BUFFER_PRE_PADDING;
-                m = lws_get_peer_write_allowance(wsi);
-                
-                if(m == 0) {
-                    goto afterwrite;
-                }
-                
-                if(m != -1 && m < n) {
-                    n = m;
-                }
-                
-                // Read from the buffer and close connection on problem
-                n = read(sess->fd, buffer + LWS_SEND_BUFFER_PRE_PADDING, n);
-                if(n < 0) {
-                    log_message(LOG_ERROR, "Problem with reading from HTTP connection\r\n");
-                    goto close_conn;
-                }
-                if(n == 0) {
-                    goto flush_close_conn;
-                }
-                
-                // Now try to write and support HTTP2 and close connection on problem
-                m = libwebsocket_write(wsi, buffer + LWS_SEND_BUFFER_PRE_PADDING, n, LWS_WRITE_HTTP);
-                if((m < 0) || (m != n && lseek(sess->fd, m - n, SEEK_CUR) < 0)) {
-                    goto close_conn;
-                }
-                if(m) {
-                    libwebsocket_set_timeout(wsi, PENDING_TIMEOUT_HTTP_CONTENT, 5);
-                }
-                
-                // If the buffer is full, wait for another call
-                if(lws_partial_buffered(wsi)) {
+            if(sess->status != 0) {
+                status = sess->status;
+                sess->status = 0;
+                libwebsockets_return_http_status(context, wsi, status, NULL);
+                goto finish;
+            }
+            if(sess->transfer == HTTP_TRANSFER_NONE) {
+                break;
+            }
+            
+            // Cached files are sent straight from memory, plain files in the kernel when possible
+            switch(sess->transfer) {
+                case HTTP_TRANSFER_MEMORY:
+                    n = _http_write_memory(context, wsi, sess);
                     break;
-                }
-            } while(!lws_send_pipe_choked(wsi));
+                case HTTP_TRANSFER_SENDFILE:
+                    n = _http_write_sendfile(context, wsi, sess);
+                    break;
+                default:
+                    n = _http_write_copy(context, wsi, sess);
+                    break;
+            }
             
-afterwrite:
-            libwebsocket_callback_on_writable(context, wsi);    
-            break;
-
-flush_close_conn:
-            if(lws_partial_buffered(wsi)) {
-                libwebsocket_callback_on_writable(context, wsi);
+            // Move on to the next part of a multipart/byteranges body
+            if(n == 1) {
+                n = _http_next_part(context, wsi, sess);
+            }
+            
+            if(n < 0) {
+                _http_session_reset(sess);
+                return -1;
+            }
+            if(n == 0) {
                 break;
             }
-            close(sess->fd);
+            
+            _http_session_reset(sess);
             goto finish;
             
-close_conn:
-            close(sess->fd);
-            return -1;
+        case LWS_CALLBACK_ADD_POLL_FD:
+        case LWS_CALLBACK_DEL_POLL_FD:
+        case LWS_CALLBACK_CHANGE_MODE_POLL_FD:
+            // The sockets are served from the main event loop
+            loop_lws_callback(reason, in);
+            break;
             
         default:
             break;
@@ -33,14 +33,64 @@
 
 #include <libwebsockets.h>
 #include <stddef.h>
+#include <stdbool.h>
+
+#include "cache.h"
+#include "config.h"
+#include "upload.h"
+
+struct http_read;
+
+/**
+ * The way a file body is moved to the client. 
+ */
+enum http_transfer {
+    HTTP_TRANSFER_NONE = 0,         // No transfer in progress
+    HTTP_TRANSFER_MEMORY,           // Sending from memory (the cache or the bundle)
+    HTTP_TRANSFER_READ,             // Copying a file through the send buffer
+    HTTP_TRANSFER_SENDFILE          // Moving a file to the socket inside the kernel
+};
+
+/**
+ * An inclusive byte range of a file. 
+ */
+struct http_range {
+    size_t start;
+    size_t end;
+};
 
 /**
  * HTTP session data structure
  */
 struct http_session {
-    int fd;     // The session socket
+    enum http_transfer transfer;    // The active transfer mode
+    int fd;                         // The file being transferred
+    struct cache_entry* entry;      // The cached file being transferred, if any
+    const unsigned char* data;      // The file contents for memory transfers
+    size_t offset;                  // Transfer offset in the file
+    size_t size;                    // Offset in the file where the current transfer stops
+    size_t total;                   // Size of the complete file
+    int range_count;                // Number of parts in a multipart/byteranges body, 0 otherwise
+    int range_index;                // The part being sent
+    const char* part_type;          // Content type of the parts
+    char boundary[DPT_WEB_IDE_HTTP_BOUNDARY_LEN + 1];               // Multipart boundary
+    struct http_range ranges[DPT_WEB_IDE_HTTP_MAX_RANGES];          // Requested byte ranges
+    struct upload* upload;          // The POST body being stored, if any
+    unsigned char* buf;             // Send buffer from the pool, only held during copying transfers
+    size_t buf_size;                // Usable size of the send buffer
+    size_t chunk;                   // Current write size, adapted to what the client drains
+    struct http_read* read;         // The file read on an I/O thread, only held during copying transfers
+    struct libwebsocket* wsi;       // The connection, set while an upload is being stored
+    unsigned int status;            // Reply to send once the upload is stored, 0 otherwise
 };
 
+/**
+ * Initialize the HTTP file server. 
+ * @param zero_copy true when files may be sent with sendfile(), only 
+ * allowed when the connections are not encrypted. 
+ */
+void http_init(bool zero_copy);
+
 /**
  * This handles HTTP protocol requests. 
  * @param context the context of the request. 
@@ -28,6 +28,8 @@
  * Created on October 2, 2015, 3:55 AM
  */
 
+#define _GNU_SOURCE
+
 #include <libwebsockets.h>
 #include <stdio.h>
 #include <errno.h>
@@ -35,37 +37,1808 @@
 #include <stdbool.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/syscall.h>
+
+#include "logger.h"
+#include "process.h"
+#include "config.h"
+#include "ide-run.h"
+#include "loop.h"
+#include "ring.h"
+#include "pool.h"
+#include "warm.h"
+#include "runq.h"
+#include "spill.h"
+
+/* Runs with an output log, attached or detached */
+static struct ide_run* runs = NULL;
+
+/* Connection and memory statistics */
+static struct ide_run_stats stats;
+
+/* False once the kernel turned out not to support memory files */
+static bool memfd_supported = true;
+
+/**
+ * Write a complete buffer to a file descriptor. 
+ * @param fd the file descriptor. 
+ * @param data the data to write. 
+ * @param len the length of the data. 
+ * @return true on success false on error. 
+ */
+static bool _ide_run_write_all(int fd, const char* data, size_t len)
+{
+    ssize_t n;
+    
+    while(len > 0) {
+        n = write(fd, data, len);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n < 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    
+    return true;
+}
+
+/**
+ * Store a big endian 32 bit value. 
+ * @param p where to store the value. 
+ * @param v the value. 
+ */
+static void _ide_run_put32(unsigned char* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/**
+ * Store a big endian 64 bit value. 
+ * @param p where to store the value. 
+ * @param v the value. 
+ */
+static void _ide_run_put64(unsigned char* p, uint64_t v)
+{
+    _ide_run_put32(p, v >> 32);
+    _ide_run_put32(p + 4, v);
+}
+
+/**
+ * Load a big endian 32 bit value. 
+ * @param p the value. 
+ * @return the value. 
+ */
+static uint32_t _ide_run_get32(const unsigned char* p)
+{
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+/**
+ * Load a big endian 64 bit value. 
+ * @param p the value. 
+ * @return the value. 
+ */
+static uint64_t _ide_run_get64(const unsigned char* p)
+{
+    return (uint64_t) _ide_run_get32(p) << 32 | _ide_run_get32(p + 4);
+}
+
+/**
+ * Write an ide-run.v1 frame header. 
+ * @param p where to write the header, IDE_RUN_HEADER bytes. 
+ * @param type the frame type. 
+ * @param len the payload length. 
+ */
+static void _ide_run_header(unsigned char* p, enum ide_run_message type, size_t len)
+{
+    p[0] = IDE_RUN_VERSION;
+    p[1] = type;
+    _ide_run_put32(p + 2, len);
+}
+
+/**
+ * Put the source code in an anonymous memory file. The file descriptor 
+ * is installed in the interpreter which opens it through /proc/self/fd. 
+ * @param src the source code. 
+ * @param len the length of the source code. 
+ * @return the file descriptor or -1 on error. 
+ */
+static int _ide_run_memfd(const char* src, size_t len)
+{
+#ifdef SYS_memfd_create
+    int fd = syscall(SYS_memfd_create, "dptwebide.js", 1 /* MFD_CLOEXEC */);
+    
+    if(fd < 0) {
+        // Only a kernel without memory files makes every later run fail the same way
+        if(errno == ENOSYS || errno == EINVAL) {
+            log_message(LOG_WARNING, "Memory files not available (%s), piping scripts instead\r\n", strerror(errno));
+            memfd_supported = false;
+        } else {
+            log_message(LOG_ERROR, "Could not create memory file: %s\r\n", strerror(errno));
+        }
+        return -1;
+    }
+    
+    if(!_ide_run_write_all(fd, src, len)) {
+        log_message(LOG_ERROR, "Could not write script to memory file: %s\r\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    
+    return fd;
+#else
+    log_message(LOG_WARNING, "Memory files not available, piping scripts instead\r\n");
+    memfd_supported = false;
+    return -1;
+#endif
+}
+
+/**
+ * Put the source code in a temporary file of its own. 
+ * @param run the run, receives the file path. 
+ * @param src the source code. 
+ * @param len the length of the source code. 
+ * @return true on success false on error. 
+ */
+static bool _ide_run_tmpfile(struct ide_run* run, const char* src, size_t len)
+{
+    int fd;
+    
+    strcpy(run->tmp_path, DPT_WEB_IDE_SCRIPT_TMP);
+    if((fd = mkstemps(run->tmp_path, 3)) < 0) {
+        log_message(LOG_ERROR, "Could not create script file: %s\r\n", strerror(errno));
+        run->tmp_path[0] = '\0';
+        return false;
+    }
+    
+    if(!_ide_run_write_all(fd, src, len)) {
+        log_message(LOG_ERROR, "Could not write to file %s\r\n", run->tmp_path);
+        close(fd);
+        unlink(run->tmp_path);
+        run->tmp_path[0] = '\0';
+        return false;
+    }
+    
+    close(fd);
+    return true;
+}
+
+static void _ide_run_feed_stdin(struct ide_run* run);
+static void _ide_run_output_ready(struct libwebsocket_context* context, int fd, short revents, void* data);
+static void _ide_run_drain(struct ide_run* run);
+static void _ide_run_stop(struct libwebsocket_context* context, struct ide_run_session* sess);
+
+/**
+ * Event loop handler for an interpreter script pipe with room for more of 
+ * the script. 
+ * @param context the websocket context. 
+ * @param fd the script pipe. 
+ * @param revents the poll events that occurred. 
+ * @param data the run. 
+ */
+static void _ide_run_stdin_ready(struct libwebsocket_context* context, int fd, short revents, void* data)
+{
+    struct ide_run* run = (struct ide_run*) data;
+    
+    _ide_run_feed_stdin(run);
+}
+
+/**
+ * Write as much of the pending script as the interpreter's script pipe 
+ * takes. The rest is written when the event loop finds the pipe writable, 
+ * the pipe is closed once the whole script is written. 
+ * @param run the run. 
+ */
+static void _ide_run_feed_stdin(struct ide_run* run)
+{
+    ssize_t n;
+    
+    while(run->script_sent < run->script_len) {
+        n = write(run->sfd, run->script + run->script_sent, run->script_len - run->script_sent);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n < 0 && errno == EAGAIN) {
+            loop_add(run->sfd, POLLOUT, _ide_run_stdin_ready, run);
+            return;
+        }
+        if(n < 0) {
+            log_message(LOG_ERROR, "Could not write to interpreter stdin: %s\r\n", strerror(errno));
+            break;
+        }
+        run->script_sent += n;
+    }
+    
+    loop_remove(run->sfd);
+    close(run->sfd);
+    free(run->script);
+    run->script = NULL;
+}
+
+/**
+ * Stop writing input to the program, its stdin is closed and the 
+ * browser may send again. 
+ * @param run the run. 
+ */
+static void _ide_run_close_input(struct ide_run* run)
+{
+    if(run->input != NULL) {
+        free(run->input);
+        run->input = NULL;
+        run->input_len = 0;
+        if(run->sess != NULL) {
+            libwebsocket_rx_flow_control(run->sess->wsi, 1);
+        }
+    }
+    if(run->ifd >= 0) {
+        loop_remove(run->ifd);
+        close(run->ifd);
+        run->ifd = -1;
+    }
+    run->input_eof = false;
+}
+
+/**
+ * Write as much of the waiting input as the program's stdin takes. 
+ * @param run the run. 
+ * @return false when the program doesn't read its stdin anymore. 
+ */
+static bool _ide_run_write_input(struct ide_run* run)
+{
+    ssize_t n;
+    
+    while(run->input_len > 0) {
+        n = write(run->ifd, run->input, run->input_len);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n < 0 && errno == EAGAIN) {
+            return true;
+        }
+        if(n < 0) {
+            log_message(LOG_DEBUG, "Could not write to program stdin: %s\r\n", strerror(errno));
+            return false;
+        }
+        memmove(run->input, run->input + n, run->input_len - n);
+        run->input_len -= n;
+    }
+    return true;
+}
+
+/**
+ * Event loop handler for a program stdin with room for more input, the 
+ * browser may send again once all input is written. 
+ * @param context the websocket context. 
+ * @param fd the stdin pipe. 
+ * @param revents the poll events that occurred. 
+ * @param data the run. 
+ */
+static void _ide_run_input_ready(struct libwebsocket_context* context, int fd, short revents, void* data)
+{
+    struct ide_run* run = (struct ide_run*) data;
+    
+    if(!_ide_run_write_input(run) || (run->input_len == 0 && run->input_eof)) {
+        _ide_run_close_input(run);
+    } else if(run->input_len == 0) {
+        loop_remove(run->ifd);
+        free(run->input);
+        run->input = NULL;
+        if(run->sess != NULL) {
+            libwebsocket_rx_flow_control(run->sess->wsi, 1);
+        }
+    }
+}
+
+/**
+ * Pass input from the browser to the program. Input that doesn't fit in 
+ * the pipe is kept and the browser is not read until it is written. 
+ * @param sess the ide-run session. 
+ * @param data the input, empty to close stdin. 
+ * @param len the length of the input. 
+ */
+static void _ide_run_input(struct ide_run_session* sess, const unsigned char* data, size_t len)
+{
+    struct ide_run* run = sess->run;
+    ssize_t n = 0;
+    char* input;
+    
+    if(run == NULL || run->ifd < 0) {
+        log_message(LOG_DEBUG, "Dropping %zu bytes of input, the program has no stdin\r\n", len);
+        return;
+    }
+    
+    if(len == 0) {
+        run->input_eof = true;
+        if(run->input == NULL) {
+            _ide_run_close_input(run);
+        }
+        return;
+    }
+    
+    // Write straight to the pipe unless older input is still waiting
+    if(run->input == NULL) {
+        do {
+            n = write(run->ifd, data, len);
+        } while(n < 0 && errno == EINTR);
+        
+        if(n < 0 && errno != EAGAIN) {
+            log_message(LOG_DEBUG, "Could not write to program stdin: %s\r\n", strerror(errno));
+            _ide_run_close_input(run);
+            return;
+        }
+        if(n == (ssize_t) len) {
+            return;
+        }
+        if(n < 0) {
+            n = 0;
+        }
+    }
+    
+    // Input sent while the browser was being held back queues up behind the rest
+    if((input = realloc(run->input, run->input_len + len - n)) == NULL) {
+        log_message(LOG_ERROR, "Could not allocate memory for program input\r\n");
+        return;
+    }
+    memcpy(input + run->input_len, data + n, len - n);
+    if(run->input == NULL) {
+        loop_add(run->ifd, POLLOUT, _ide_run_input_ready, run);
+        libwebsocket_rx_flow_control(sess->wsi, 0);
+    }
+    run->input = input;
+    run->input_len += len - n;
+}
+
+/**
+ * Find where a frame of output can end without splitting a UTF-8 
+ * character, text frames must be valid UTF-8. 
+ * @param buf the output. 
+ * @param len the length of the output. 
+ * @return the length up to the last complete character. 
+ */
+static size_t _ide_run_utf8_boundary(const unsigned char* buf, size_t len)
+{
+    size_t i = len, need;
+    
+    /* Find the start of the last character, at most 4 bytes back */
+    while(i > 0 && len - i < 4 && (buf[i - 1] & 0xC0) == 0x80) {
+        i--;
+    }
+    if(i == 0 || buf[i - 1] < 0xC0) {
+        return len;
+    }
+    
+    need = buf[i - 1] >= 0xF0 ? 4 : buf[i - 1] >= 0xE0 ? 3 : 2;
+    return len - (i - 1) >= need ? len : i - 1;
+}
+
+/**
+ * Stop the interpreter but keep its buffered output. Its exit status 
+ * still reaches the browser once it is gone. 
+ * @param run the run. 
+ */
+static void _ide_run_kill(struct ide_run* run)
+{
+    if(run->proc.pid > 0) {
+        log_message(LOG_DEBUG, "Stopping process: %d\r\n", (int) run->proc.pid);
+        loop_remove(run->proc.out);
+        loop_remove(run->proc.err);
+        process_stop(&run->proc);
+        run->eof = true;
+    }
+}
+
+/**
+ * Watch the output pipes of the interpreter that are still open. 
+ * @param run the run. 
+ */
+static void _ide_run_watch(struct ide_run* run)
+{
+    if(run->proc.out >= 0) {
+        loop_add(run->proc.out, POLLIN, _ide_run_output_ready, run);
+    }
+    if(run->proc.err >= 0) {
+        loop_add(run->proc.err, POLLIN, _ide_run_output_ready, run);
+    }
+}
+
+/**
+ * Timer handler sending the output collected during a tick. 
+ * @param context the websocket context. 
+ * @param data the run. 
+ */
+static void _ide_run_flush(struct libwebsocket_context* context, void* data)
+{
+    struct ide_run* run = (struct ide_run*) data;
+    
+    if(run->sess != NULL) {
+        libwebsocket_callback_on_writable(context, run->sess->wsi);
+    }
+}
+
+/**
+ * Ask for writeable callbacks on every connection reading the log of a 
+ * run, its own and those of its subscribers. 
+ * @param context the websocket context. 
+ * @param run the run. 
+ */
+static void _ide_run_notify(struct libwebsocket_context* context, struct ide_run* run)
+{
+    struct ide_run_session* w;
+    
+    if(run->sess != NULL) {
+        libwebsocket_callback_on_writable(context, run->sess->wsi);
+    }
+    for(w = run->subscribers; w != NULL; w = w->next_subscriber) {
+        libwebsocket_callback_on_writable(context, w->wsi);
+    }
+}
+
+/**
+ * Ask for a writeable callback once enough output is buffered for a full 
+ * frame, the output ended or the coalescing tick passed. 
+ * @param context the websocket context. 
+ * @param run the run. 
+ */
+static void _ide_run_schedule(struct libwebsocket_context* context, struct ide_run* run)
+{
+    // Output that isn't for this connection alone goes to the log, everyone reads it from there
+    if(run->sess == NULL || run->subscribers != NULL) {
+        _ide_run_drain(run);
+        _ide_run_notify(context, run);
+        return;
+    }
+    
+    if(run->output.used >= DPT_WEB_IDE_OUTPUT_FRAME || (run->eof && (run->output.used > 0 || run->killed || run->exited))) {
+        loop_timer_stop(&run->flush);
+        libwebsocket_callback_on_writable(context, run->sess->wsi);
+    } else if(run->output.used > 0 && !run->flush.armed) {
+        loop_timer_start(&run->flush, DPT_WEB_IDE_OUTPUT_TICK, _ide_run_flush, run);
+    }
+}
+
+/**
+ * Write a message about the run the way the session's protocol shows it, 
+ * a bracketed line of text or a notice frame. 
+ * @param binary whether the session uses the binary protocol. 
+ * @param buf the message buffer. 
+ * @param size the size of the buffer. 
+ * @param text the message. 
+ * @return the length of the message. 
+ */
+static size_t _ide_run_notice(bool binary, unsigned char* buf, size_t size, const char* text)
+{
+    int n;
+    
+    if(!binary) {
+        n = snprintf((char*) buf, size, "\r\n[%s]\r\n", text);
+        return n < (int) size ? n : size - 1;
+    }
+    
+    n = snprintf((char*) buf + IDE_RUN_HEADER, size - IDE_RUN_HEADER, "%s", text);
+    n = n < (int) (size - IDE_RUN_HEADER) ? n : size - IDE_RUN_HEADER - 1;
+    _ide_run_header(buf, IDE_RUN_MSG_NOTICE, n);
+    return IDE_RUN_HEADER + n;
+}
+
+/**
+ * Get the room left in the output buffer for program output. 
+ * @param run the run. 
+ * @return the number of bytes of output that fit. 
+ */
+static size_t _ide_run_room(struct ide_run* run)
+{
+    size_t space = ring_space(&run->output);
+    
+    if(!run->binary) {
+        return space;
+    }
+    return space > IDE_RUN_HEADER ? space - IDE_RUN_HEADER : 0;
+}
+
+/**
+ * Put a marker telling how much output was dropped in the output buffer. 
+ * @param run the run. 
+ * @return false when dropped output is still waiting to be reported. 
+ */
+static bool _ide_run_mark_skipped(struct ide_run* run)
+{
+    unsigned char marker[IDE_RUN_HEADER + 64];
+    char text[64];
+    size_t n;
+    
+    if(run->skipped == 0) {
+        return true;
+    }
+    
+    snprintf(text, sizeof(text), "%llu bytes skipped", run->skipped);
+    n = _ide_run_notice(run->binary, marker, sizeof(marker), text);
+    if(ring_space(&run->output) <= n) {
+        return false;
+    }
+    
+    ring_write(&run->output, marker, n);
+    run->skipped = 0;
+    return true;
+}
+
+/**
+ * Read one chunk of output into the output buffer as a stdout or stderr 
+ * frame. 
+ * @param run the run. 
+ * @param fd the stdout or stderr pipe. 
+ * @param buf a buffer of DPT_WEB_IDE_PROC_READ_BUFF bytes. 
+ * @return the result of read(). 
+ */
+static ssize_t _ide_run_read_chunk(struct ide_run* run, int fd, unsigned char* buf)
+{
+    unsigned char header[IDE_RUN_HEADER];
+    size_t room = _ide_run_room(run);
+    ssize_t n;
+    
+    n = read(fd, buf, room < DPT_WEB_IDE_PROC_READ_BUFF ? room : DPT_WEB_IDE_PROC_READ_BUFF);
+    if(n > 0) {
+        _ide_run_header(header, fd == run->proc.err ? IDE_RUN_MSG_STDERR : IDE_RUN_MSG_STDOUT, n);
+        ring_write(&run->output, header, sizeof(header));
+        ring_write(&run->output, buf, n);
+    }
+    return n;
+}
+
+/**
+ * Move interpreter output from a pipe to the output buffer and apply 
+ * the overflow policy when the buffer is full. At most one frame is read 
+ * per call so a chatty interpreter can't starve the server. 
+ * @param context the websocket context. 
+ * @param run the run. 
+ * @param fd the stdout or stderr pipe. 
+ */
+static void _ide_run_fill(struct libwebsocket_context* context, struct ide_run* run, int fd)
+{
+    unsigned char buf[DPT_WEB_IDE_PROC_READ_BUFF];
+    size_t total = 0;
+    ssize_t n;
+    
+    while((fd == run->proc.out || fd == run->proc.err) && total < DPT_WEB_IDE_OUTPUT_FRAME) {
+        /* Tell the browser about dropped output before newer output */
+        if(_ide_run_mark_skipped(run) && _ide_run_room(run) > 0) {
+            n = run->binary ? _ide_run_read_chunk(run, fd, buf) : ring_read_fd(&run->output, fd);
+        } else if(conf->output_policy == CONFIG_OVERFLOW_DROP) {
+            n = read(fd, buf, sizeof(buf));
+            if(n > 0) {
+                run->dropped += n;
+                run->skipped += n;
+                total += n;
+                continue;
+            }
+        } else if(conf->output_policy == CONFIG_OVERFLOW_KILL) {
+            log_message(LOG_WARNING, "Interpreter %d exceeded its output buffer, stopping it\r\n", (int) run->proc.pid);
+            _ide_run_kill(run);
+            run->killed = true;
+            break;
+        } else {
+            /* The interpreter blocks on the full pipes until the browser catches up */
+            loop_remove(run->proc.out);
+            loop_remove(run->proc.err);
+            run->paused = true;
+            break;
+        }
+        
+        if(n > 0) {
+            total += n;
+            continue;
+        }
+        if(n < 0 && errno == EAGAIN) {
+            break;
+        }
+        if(n < 0) {
+            log_message(LOG_ERROR, "Could not read from interpreter output: %s (fd = %d)\r\n", strerror(errno), fd);
+        }
+        
+        // The interpreter closed this pipe, the output ends when both are closed
+        loop_remove(fd);
+        close(fd);
+        if(fd == run->proc.out) {
+            run->proc.out = -1;
+        } else {
+            run->proc.err = -1;
+        }
+        run->eof = run->proc.out < 0 && run->proc.err < 0;
+        break;
+    }
+    
+    if(conf->run_output_limit > 0 && !run->eof && 
+       run->forwarded + run->output.used + run->dropped > (unsigned long long) conf->run_output_limit * 1024) {
+        log_message(LOG_WARNING, "Interpreter %d exceeded the output limit of a run, stopping it\r\n", (int) run->proc.pid);
+        _ide_run_kill(run);
+        run->killed = true;
+    }
+    
+    _ide_run_schedule(context, run);
+}
+
+/**
+ * Event loop handler for interpreter output. 
+ * @param context the websocket context. 
+ * @param fd the stdout or stderr pipe. 
+ * @param revents the poll events that occurred. 
+ * @param data the run. 
+ */
+static void _ide_run_output_ready(struct libwebsocket_context* context, int fd, short revents, void* data)
+{
+    _ide_run_fill(context, (struct ide_run*) data, fd);
+}
+
+/**
+ * Exit handler of the interpreter, its status is sent after the last output. 
+ * @param context the websocket context. 
+ * @param status how the interpreter ended. 
+ * @param data the run. 
+ */
+static void _ide_run_exited(struct libwebsocket_context* context, const struct process_status* status, void* data)
+{
+    struct ide_run* run = (struct ide_run*) data;
+    
+    log_message(LOG_INFO, "Interpreter %d ended: code %d, signal %d, %lld ms, %lld us user, %lld us sys, %ld KB max RSS\r\n", 
+            (int) run->proc.pid, status->code, status->signal, status->wall_ms, status->user_us, status->sys_us, status->max_rss_kb);
+    run->proc.pid = -1;
+    run->status = *status;
+    run->exited = true;
+    _ide_run_schedule(context, run);
+    
+    run->slot = false;
+    runq_release(context);
+}
+
+/**
+ * Write a stats frame with a queue position and the output counters of 
+ * a run. 
+ * @param run the run, NULL while none was started. 
+ * @param position the queue position. 
+ * @param buf the frame buffer. 
+ * @return the length of the frame. 
+ */
+static size_t _ide_run_format_stats(const struct ide_run* run, int position, unsigned char* buf)
+{
+    struct runq_stats rs;
+    
+    runq_get_stats(&rs);
+    _ide_run_header(buf, IDE_RUN_MSG_STATS, 28);
+    _ide_run_put32(buf + IDE_RUN_HEADER, position);
+    _ide_run_put32(buf + IDE_RUN_HEADER + 4, rs.running);
+    _ide_run_put32(buf + IDE_RUN_HEADER + 8, rs.waiting);
+    _ide_run_put64(buf + IDE_RUN_HEADER + 12, run != NULL ? run->forwarded : 0);
+    _ide_run_put64(buf + IDE_RUN_HEADER + 20, run != NULL ? run->dropped : 0);
+    return IDE_RUN_HEADER + 28;
+}
+
+/**
+ * Write the final message of a run describing how the interpreter ended, 
+ * binary sessions get a stats frame followed by an exit frame. 
+ * @param run the run. 
+ * @param buf the message buffer, at least one frame. 
+ * @return the length of the message. 
+ */
+static size_t _ide_run_format_status(struct ide_run* run, unsigned char* buf)
+{
+    const struct process_status* st = &run->status;
+    unsigned char* p;
+    char ended[32];
+    
+    if(run->binary) {
+        p = buf + _ide_run_format_stats(run, 0, buf);
+        _ide_run_header(p, IDE_RUN_MSG_EXIT, 40);
+        _ide_run_put32(p + IDE_RUN_HEADER, st->code);
+        _ide_run_put32(p + IDE_RUN_HEADER + 4, st->signal);
+        _ide_run_put64(p + IDE_RUN_HEADER + 8, st->wall_ms);
+        _ide_run_put64(p + IDE_RUN_HEADER + 16, st->user_us);
+        _ide_run_put64(p + IDE_RUN_HEADER + 24, st->sys_us);
+        _ide_run_put64(p + IDE_RUN_HEADER + 32, st->max_rss_kb);
+        return p + IDE_RUN_HEADER + 40 - buf;
+    }
+    
+    if(st->signal != 0) {
+        snprintf(ended, sizeof(ended), "killed by signal %d", st->signal);
+    } else {
+        snprintf(ended, sizeof(ended), "exited with code %d", st->code);
+    }
+    
+    return snprintf((char*) buf, DPT_WEB_IDE_OUTPUT_FRAME, 
+            "\r\n[%s after %lld.%03lld s, cpu %lld.%03lld s user %lld.%03lld s sys, max rss %ld KB]\r\n", 
+            ended, st->wall_ms / 1000, st->wall_ms % 1000, st->user_us / 1000000, st->user_us / 1000 % 1000, 
+            st->sys_us / 1000000, st->sys_us / 1000 % 1000, st->max_rss_kb);
+}
+
+/**
+ * Find where a message of binary output can end without splitting a frame. 
+ * @param buf the output. 
+ * @param len the length of the output. 
+ * @return the length up to the last complete frame. 
+ */
+static size_t _ide_run_frame_boundary(const unsigned char* buf, size_t len)
+{
+    size_t i = 0;
+    
+    while(len - i >= IDE_RUN_HEADER && len - i - IDE_RUN_HEADER >= _ide_run_get32(buf + i + 2)) {
+        i += IDE_RUN_HEADER + _ide_run_get32(buf + i + 2);
+    }
+    return i;
+}
+
+/**
+ * Keep output of a detachable run for replay after a reconnect. 
+ * @param run the run. 
+ * @param frames whole frames of output. 
+ * @param len the length of the frames. 
+ */
+static void _ide_run_log(struct ide_run* run, const unsigned char* frames, size_t len)
+{
+    if(run->run_id != 0) {
+        spill_append(&run->log, frames, len);
+    }
+}
+
+/**
+ * Move the buffered output of a run to its log, the interpreter is never 
+ * held back by a detached or slow reader. Frames are moved one at a time 
+ * so a run without a connection needs no send buffer. 
+ * @param run the run. 
+ */
+static void _ide_run_drain(struct ide_run* run)
+{
+    unsigned char frame[IDE_RUN_HEADER + DPT_WEB_IDE_PROC_READ_BUFF];
+    size_t n;
+    
+    while(ring_peek(&run->output, frame, IDE_RUN_HEADER) == IDE_RUN_HEADER 
+            && (n = IDE_RUN_HEADER + _ide_run_get32(frame + 2)) <= run->output.used && n <= sizeof(frame)) {
+        ring_peek(&run->output, frame, n);
+        ring_consume(&run->output, n);
+        run->forwarded += n;
+        _ide_run_log(run, frame, n);
+    }
+    _ide_run_mark_skipped(run);
+    
+    if(run->paused) {
+        run->paused = false;
+        _ide_run_watch(run);
+    }
+}
+
+/**
+ * Send the next frame of buffered output to the browser. 
+ * @param context the websocket context. 
+ * @param wsi the websocket of the session. 
+ * @param sess the ide-run session. 
+ * @return 0 on success or -1 when the connection must be closed. 
+ */
+static int _ide_run_send(struct libwebsocket_context* context, struct libwebsocket* wsi, struct ide_run_session* sess)
+{
+    struct ide_run* run = sess->run;
+    unsigned char* frame = sess->frame + LWS_SEND_BUFFER_PRE_PADDING;
+    bool done = false;
+    size_t n;
+    
+    // Binary messages carry whole frames, text messages whole characters
+    n = ring_peek(&run->output, frame, DPT_WEB_IDE_OUTPUT_FRAME);
+    if(run->binary) {
+        n = _ide_run_frame_boundary(frame, n);
+    } else if(run->output.used > n || !run->eof) {
+        n = _ide_run_utf8_boundary(frame, n);
+    }
+    
+    if(n == 0 && run->output.used == 0 && run->killed) {
+        n = _ide_run_notice(run->binary, frame, DPT_WEB_IDE_OUTPUT_FRAME, "output limit exceeded, interpreter stopped");
+        _ide_run_log(run, frame, n);
+        run->killed = false;
+    } else if(n == 0 && run->output.used == 0 && run->eof && run->exited) {
+        n = _ide_run_format_status(run, frame);
+        run->exited = false;
+        done = true;
+    } else {
+        ring_consume(&run->output, n);
+        run->forwarded += n;
+        _ide_run_log(run, frame, n);
+    }
+    
+    // Logged output counts as sent, a reconnect picks up what got lost
+    sess->replay = run->log.end;
+    if(n > 0) {
+        if(libwebsocket_write(wsi, frame, n, run->binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT) < 0) {
+            return -1;
+        }
+        run->frames++;
+    }
+    
+    // A finished run nobody can reattach to has nothing left to keep
+    if(done && run->run_id == 0) {
+        _ide_run_stop(context, sess);
+        return 0;
+    }
+    
+    // Report output dropped before the interpreter went quiet
+    if(n > 0) {
+        _ide_run_mark_skipped(run);
+    }
+    
+    // Resume a paused interpreter once half of the buffer is free again
+    if(run->paused && ring_space(&run->output) >= run->output.size / 2) {
+        run->paused = false;
+        _ide_run_watch(run);
+    }
+    
+    // Keep draining while complete output is buffered
+    if((n > 0 && run->output.used > 0) || run->killed || (run->eof && run->exited)) {
+        libwebsocket_callback_on_writable(context, wsi);
+    }
+    return 0;
+}
+
+/**
+ * Exit handler of an abandoned interpreter, its slot is free once it is gone. 
+ * @param context the websocket context. 
+ * @param status how the interpreter ended. 
+ * @param data unused. 
+ */
+static void _ide_run_released(struct libwebsocket_context* context, const struct process_status* status, void* data)
+{
+    runq_release(context);
+}
+
+/**
+ * Stop watching the run of another connection. 
+ * @param sess the ide-run session. 
+ */
+static void _ide_run_unsubscribe(struct ide_run_session* sess)
+{
+    struct ide_run_session** p;
+    
+    if(sess->producer == NULL) {
+        return;
+    }
+    
+    for(p = &sess->producer->subscribers; *p != sess; p = &(*p)->next_subscriber);
+    *p = sess->next_subscriber;
+    sess->producer->subscriber_count--;
+    sess->producer = NULL;
+    sess->next_subscriber = NULL;
+    pool_release(sess->frame, sess->frame_size);
+    sess->frame = NULL;
+    sess->frame_size = 0;
+}
+
+/**
+ * Stop the interpreter of a run, clean up the script it was given and its 
+ * output and give its memory back to the pool. 
+ * @param context the websocket context. 
+ * @param run the run. 
+ */
+static void _ide_run_discard(struct libwebsocket_context* context, struct ide_run* run)
+{
+    struct ide_run** p;
+    struct ide_run_session* w;
+    
+    // Nobody is interested in how a replaced or abandoned run ends, it keeps its slot until it is gone
+    _ide_run_kill(run);
+    if(run->proc.pid > 0) {
+        process_on_exit(run->proc.pid, _ide_run_released, NULL);
+        run->proc.pid = -1;
+        run->slot = false;
+    }
+    if(run->slot) {
+        run->slot = false;
+        runq_release(context);
+    }
+    
+    if(run->script != NULL) {
+        loop_remove(run->sfd);
+        close(run->sfd);
+        free(run->script);
+    }
+    
+    _ide_run_close_input(run);
+    
+    if(run->tmp_path[0] != '\0') {
+        unlink(run->tmp_path);
+    }
+    
+    if(run->output.data != NULL) {
+        log_message(LOG_INFO, "Interpreter output: %llu bytes forwarded in %lu frames, %llu bytes dropped\r\n", 
+                run->forwarded, run->frames, run->dropped);
+        ring_free(&run->output);
+    }
+    loop_timer_stop(&run->flush);
+    loop_timer_stop(&run->grace);
+    
+    if(run->run_id != 0) {
+        // Subscribers are told the run is gone with run id 0
+        while((w = run->subscribers) != NULL) {
+            _ide_run_unsubscribe(w);
+            w->replay = 0;
+            w->announce = true;
+            libwebsocket_callback_on_writable(context, w->wsi);
+        }
+        
+        for(p = &runs; *p != run; p = &(*p)->next_run);
+        *p = run->next_run;
+        spill_free(&run->log);
+    }
+    
+    stats.runs--;
+    pool_release(run, run->alloc);
+}
+
+/**
+ * Stop the run of a session or stop watching one and free the send buffer. 
+ * @param context the websocket context. 
+ * @param sess the ide-run session. 
+ */
+static void _ide_run_stop(struct libwebsocket_context* context, struct ide_run_session* sess)
+{
+    _ide_run_unsubscribe(sess);
+    
+    if(sess->run != NULL) {
+        _ide_run_discard(context, sess->run);
+        sess->run = NULL;
+    }
+    
+    pool_release(sess->frame, sess->frame_size);
+    sess->frame = NULL;
+    sess->frame_size = 0;
+    sess->announce = false;
+}
+
+/**
+ * Keep a copy of the script to write to the interpreter's stdin. 
+ * @param run the run. 
+ * @param fd the write end of the interpreter's stdin, non blocking. 
+ * @param src the source code. 
+ * @param len the length of the source code. 
+ * @return true on success false on error. 
+ */
+static bool _ide_run_queue_script(struct ide_run* run, int fd, const char* src, size_t len)
+{
+    if((run->script = malloc(len)) == NULL) {
+        return false;
+    }
+    
+    memcpy(run->script, src, len);
+    run->script_len = len;
+    run->script_sent = 0;
+    run->sfd = fd;
+    return true;
+}
+
+/**
+ * Start a new interpreter on a script using the configured hand-off mode. 
+ * A run whose memory file fails pipes its script on stdin instead, all 
+ * later runs do so when the kernel doesn't support memory files. 
+ * The caller cleans up the run on errors. 
+ * @param run the run. 
+ * @param src the source code. 
+ * @param len the length of the source code. 
+ * @param limits the limits the interpreter starts with. 
+ * @return true on success false on error. 
+ */
+static bool _ide_run_spawn(struct ide_run* run, const char* src, size_t len, const struct process_limits* limits)
+{
+    const char* argv[] = { DPT_WEB_IDE_INTERPRETER_CMD, NULL, NULL };
+    struct process_options opts;
+    struct process_fd_map map[2];
+    config_handoff mode = conf->script_handoff;
+    char fd_path[32];
+    int pipe_fd[2];
+    int i;
+    bool ok;
+    
+    memset(&opts, 0, sizeof(opts));
+    opts.argv = argv;
+    opts.fds = map;
+    opts.limits = limits;
+    
+    // Scripts run inside the project directory when there is one
+    if(access(conf->project_path, X_OK) == 0) {
+        opts.cwd = conf->project_path;
+    }
+    
+    if(mode == CONFIG_HANDOFF_MEMFD && !memfd_supported) {
+        mode = CONFIG_HANDOFF_STDIN;
+    }
+    
+    if(mode == CONFIG_HANDOFF_MEMFD) {
+        if((map[0].fd = _ide_run_memfd(src, len)) < 0) {
+            mode = CONFIG_HANDOFF_STDIN;
+        } else {
+            map[0].target = DPT_WEB_IDE_SCRIPT_FD;
+            opts.fd_count = 1;
+            snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", DPT_WEB_IDE_SCRIPT_FD);
+            argv[1] = fd_path;
+        }
+    }
+    
+    if(mode == CONFIG_HANDOFF_STDIN) {
+        if(pipe2(pipe_fd, O_CLOEXEC)) {
+            log_message(LOG_ERROR, "Could not create interpreter stdin pipe\r\n");
+            return false;
+        }
+        if(!_ide_run_queue_script(run, pipe_fd[1], src, len)) {
+            close(pipe_fd[0]);
+            close(pipe_fd[1]);
+            return false;
+        }
+        fcntl(run->sfd, F_SETFL, O_NONBLOCK);
+        map[0].fd = pipe_fd[0];
+        map[0].target = 0;
+        opts.fd_count = 1;
+        argv[1] = "/dev/stdin";
+    }
+    
+    if(mode == CONFIG_HANDOFF_FILE) {
+        if(!_ide_run_tmpfile(run, src, len)) {
+            return false;
+        }
+        argv[1] = run->tmp_path;
+    }
+    
+    // Stdin is free for the program when the script doesn't come through it
+    if(mode != CONFIG_HANDOFF_STDIN) {
+        if(pipe2(pipe_fd, O_CLOEXEC)) {
+            log_message(LOG_ERROR, "Could not create interpreter stdin pipe\r\n");
+            for(i = 0; i < opts.fd_count; ++i) {
+                close(map[i].fd);
+            }
+            return false;
+        }
+        map[opts.fd_count].fd = pipe_fd[0];
+        map[opts.fd_count].target = 0;
+        opts.fd_count++;
+        run->ifd = pipe_fd[1];
+        fcntl(run->ifd, F_SETFL, O_NONBLOCK);
+    }
+    
+    ok = process_spawn(&opts, &run->proc);
+    
+    // The interpreter holds its own copies of the descriptors now
+    for(i = 0; i < opts.fd_count; ++i) {
+        close(map[i].fd);
+    }
+    
+    return ok;
+}
+
+/**
+ * Make up the id of a detachable run. Ids are random when the kernel can 
+ * provide random numbers so one browser can't guess the run of another. 
+ * @return the id, never 0. 
+ */
+static uint64_t _ide_run_new_id(void)
+{
+    static uint64_t counter = 0;
+    uint64_t id = 0;
+    
+#ifdef SYS_getrandom
+    if(syscall(SYS_getrandom, &id, sizeof(id), 0) != sizeof(id)) {
+        id = 0;
+    }
+#endif
+    
+    return id != 0 ? id : ++counter;
+}
+
+/**
+ * Start the interpreter on a script, an idle one from the interpreter 
+ * pool when available. The session must hold a run slot, the state of the 
+ * run comes from the buffer pool and is only kept while the run exists. 
+ * @param context the websocket context. 
+ * @param sess the ide-run session. 
+ * @param src the source code. 
+ * @param len the length of the source code. 
+ * @return true on success false on error. 
+ */
+static bool _ide_run_start(struct libwebsocket_context* context, struct ide_run_session* sess, const char* src, size_t len)
+{
+    struct process_limits limits;
+    struct warm_process wp;
+    struct ide_run* run;
+    size_t alloc;
+    
+    if((run = pool_alloc(sizeof(struct ide_run), &alloc)) == NULL) {
+        log_message(LOG_ERROR, "Could not allocate memory for a run\r\n");
+        runq_release(context);
+        return false;
+    }
+    memset(run, 0, sizeof(struct ide_run));
+    run->alloc = alloc;
+    run->sess = sess;
+    run->binary = sess->binary;
+    run->slot = true;
+    run->proc.pid = -1;
+    run->proc.out = -1;
+    run->proc.err = -1;
+    run->ifd = -1;
+    sess->run = run;
+    stats.runs++;
+    
+    limits.cpu_seconds = conf->run_cpu_limit;
+    limits.memory_kb = conf->run_memory_limit;
+    limits.files = conf->run_file_limit;
+    limits.cgroup = conf->run_cgroup;
+    
+    // An idle interpreter from the pool only needs the script on its pipe, it is limited before the script is sent
+    if(warm_claim(&wp)) {
+        run->proc = wp.proc;
+        run->ifd = wp.stdin_fd;
+        if(!process_limit(run->proc.pid, &limits)) {
+            close(wp.script_fd);
+            _ide_run_stop(context, sess);
+            return false;
+        }
+        if(!_ide_run_queue_script(run, wp.script_fd, src, len)) {
+            close(wp.script_fd);
+            _ide_run_stop(context, sess);
+            return false;
+        }
+    } else if(!_ide_run_spawn(run, src, len, &limits)) {
+        _ide_run_stop(context, sess);
+        return false;
+    }
+    
+    // The text protocol can't send input, the program reads end of file
+    if(!run->binary) {
+        _ide_run_close_input(run);
+    }
+    
+    // The status follows the output once the interpreter is reaped
+    process_on_exit(run->proc.pid, _ide_run_exited, run);
+    
+    // Output is buffered per run and sent in frames
+    if(!ring_init(&run->output, (size_t) conf->output_buffer_size * 1024) || 
+       (sess->frame = pool_alloc(LWS_SEND_BUFFER_PRE_PADDING + DPT_WEB_IDE_OUTPUT_FRAME + LWS_SEND_BUFFER_POST_PADDING, &sess->frame_size)) == NULL) {
+        log_message(LOG_ERROR, "Could not allocate interpreter output buffers\r\n");
+        _ide_run_stop(context, sess);
+        return false;
+    }
+    
+    // Binary runs can outlive their connection or be shared, the browser learns the run id first
+    if(run->binary && (conf->detach_grace > 0 || conf->run_subscribers > 0)) {
+        if(!spill_init(&run->log, (size_t) conf->detach_log_size * 1024, (size_t) conf->detach_spill_size * 1024)) {
+            log_message(LOG_ERROR, "Could not allocate interpreter output log\r\n");
+            _ide_run_stop(context, sess);
+            return false;
+        }
+        run->run_id = _ide_run_new_id();
+        run->next_run = runs;
+        runs = run;
+        sess->replay = 0;
+        sess->announce = true;
+        libwebsocket_callback_on_writable(context, sess->wsi);
+    }
+    
+    _ide_run_watch(run);
+    
+    if(run->script != NULL) {
+        _ide_run_feed_stdin(run);
+    }
+    return true;
+}
 
-#include "logger.h"
-#include "process.h"
-#include "config.h"
-#include "ide-run.h"
+/**
+ * Account for the memory a session holds right now, its own state and 
+ * buffers and those of the run it owns. 
+ * @param sess the ide-run session. 
+ */
+static void _ide_run_measure(struct ide_run_session* sess)
+{
+    const struct ide_run* run = sess->run;
+    size_t n = sizeof(struct ide_run_session) + sess->msg_size + sess->source_len + sess->pending_len + sess->frame_size;
+    
+    if(run != NULL) {
+        n += run->alloc + run->output.alloc + run->log.mem.alloc + run->script_len + run->input_len;
+    }
+    if(n > sess->peak) {
+        sess->peak = n;
+    }
+    if(n > stats.peak_footprint) {
+        stats.peak_footprint = n;
+    }
+}
 
 /**
- * Dump a constant string in a file and close it. 
- * @param dmp the string to dump. 
- * @param filename the filename to write to. 
- * @return true on success false on error. 
+ * Run queue handler, starts the waiting script once the session got a 
+ * slot and tells the browser about its new position otherwise. 
+ * @param context the websocket context. 
+ * @param data the ide-run session. 
+ * @param position the queue position, 0 when a slot was taken. 
  */
-static bool _dump_to_file(const char* dmp, const char* filename)
+static void _ide_run_admitted(struct libwebsocket_context* context, void* data, int position)
 {
-    FILE *f = fopen(filename, "w");
-    if(f == NULL)
-    {
-        log_message(LOG_ERROR, "Could not open file %s\r\n", filename);
-        return false;
+    struct ide_run_session* sess = (struct ide_run_session*) data;
+    
+    sess->position = position;
+    if(position > 0) {
+        libwebsocket_callback_on_writable(context, sess->wsi);
+        return;
+    }
+    
+    sess->reported = 0;
+    _ide_run_start(context, sess, sess->pending, sess->pending_len);
+    free(sess->pending);
+    sess->pending = NULL;
+    _ide_run_measure(sess);
+}
+
+/**
+ * Drop the script of a session that waits for a run slot. 
+ * @param context the websocket context. 
+ * @param sess the ide-run session. 
+ */
+static void _ide_run_cancel(struct libwebsocket_context* context, struct ide_run_session* sess)
+{
+    runq_cancel(context, &sess->queue);
+    free(sess->pending);
+    sess->pending = NULL;
+    sess->position = 0;
+}
+
+/**
+ * Run a script as soon as a run slot is free. A script submitted while 
+ * an older one waits takes over its place in the queue. 
+ * @param context the websocket context. 
+ * @param sess the ide-run session. 
+ * @param src the source code. 
+ * @param len the length of the source code. 
+ */
+static void _ide_run_submit(struct libwebsocket_context* context, struct ide_run_session* sess, const char* src, size_t len)
+{
+    char* copy;
+    
+    if(!sess->queue.queued && runq_acquire(&sess->queue, _ide_run_admitted, sess)) {
+        _ide_run_start(context, sess, src, len);
+        return;
+    }
+    
+    // The websocket buffer is reused, the script has to be copied to wait
+    if((copy = malloc(len)) == NULL) {
+        log_message(LOG_ERROR, "Could not allocate memory for a waiting script\r\n");
+        _ide_run_cancel(context, sess);
+        return;
+    }
+    memcpy(copy, src, len);
+    free(sess->pending);
+    sess->pending = copy;
+    sess->pending_len = len;
+    
+    sess->position = runq_position(&sess->queue);
+    log_message(LOG_INFO, "No interpreter slot free, run queued at position %d\r\n", sess->position);
+    libwebsocket_callback_on_writable(context, sess->wsi);
+}
+
+/**
+ * Tell the browser where its run is in the queue. 
+ * @param context the websocket context. 
+ * @param wsi the websocket of the session. 
+ * @param sess the ide-run session. 
+ * @return 0 on success or -1 when the connection must be closed. 
+ */
+static int _ide_run_send_position(struct libwebsocket_context* context, struct libwebsocket* wsi, struct ide_run_session* sess)
+{
+    unsigned char buf[LWS_SEND_BUFFER_PRE_PADDING + IDE_RUN_HEADER + 64 + LWS_SEND_BUFFER_POST_PADDING];
+    unsigned char* msg = buf + LWS_SEND_BUFFER_PRE_PADDING;
+    char text[64];
+    size_t n;
+    
+    if(sess->binary) {
+        n = _ide_run_format_stats(sess->run, sess->position, msg);
+    } else {
+        snprintf(text, sizeof(text), "waiting for a free interpreter, position %d", sess->position);
+        n = _ide_run_notice(sess->binary, msg, IDE_RUN_HEADER + 64, text);
+    }
+    
+    if(libwebsocket_write(wsi, msg, n, sess->binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT) < 0) {
+        return -1;
+    }
+    sess->reported = sess->position;
+    return 0;
+}
+
+/**
+ * 64 bit FNV-1a hash of a source. 
+ * @param src the source code. 
+ * @param len the length of the source code. 
+ * @return the hash. 
+ */
+static uint64_t _ide_run_hash(const char* src, size_t len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    
+    while(len-- > 0) {
+        hash ^= (unsigned char) *src++;
+        hash *= 1099511628211ULL;
+    }
+    
+    return hash;
+}
+
+/**
+ * Remember the source of a run so the next run can be sent as a patch. 
+ * @param sess the ide-run session. 
+ * @param src the source code, owned by the session afterwards. 
+ * @param len the length of the source code. 
+ */
+static void _ide_run_keep_source(struct ide_run_session* sess, char* src, size_t len)
+{
+    free(sess->source);
+    sess->source = src;
+    sess->source_len = len;
+    sess->source_hash = src != NULL ? _ide_run_hash(src, len) : 0;
+}
+
+/**
+ * Run a complete script sent by a binary session and keep it as the base 
+ * for patches. 
+ * @param context the websocket context. 
+ * @param sess the ide-run session. 
+ * @param src the source code. 
+ * @param len the length of the source code. 
+ */
+static void _ide_run_full(struct libwebsocket_context* context, struct ide_run_session* sess, const char* src, size_t len)
+{
+    char* copy = malloc(len > 0 ? len : 1);
+    
+    if(copy != NULL) {
+        memcpy(copy, src, len);
+    }
+    _ide_run_keep_source(sess, copy, len);
+    
+    _ide_run_stop(context, sess);
+    _ide_run_submit(context, sess, src, len);
+}
+
+/**
+ * Apply a patch to the last source and run the result. The browser is 
+ * asked for the full source when the patch is for another version. 
+ * @param context the websocket context. 
+ * @param sess the ide-run session. 
+ * @param data the patch. 
+ * @param size the length of the patch. 
+ * @return 0 on success or -1 when the patch is malformed. 
+ */
+static int _ide_run_patch(struct libwebsocket_context* context, struct ide_run_session* sess, const unsigned char* data, size_t size)
+{
+    const unsigned char* end = data + size;
+    const unsigned char* p;
+    size_t pos, len = 0;
+    uint32_t off, del, ins;
+    char* src;
+    
+    if(size < 8) {
+        return -1;
+    }
+    
+    if(sess->source == NULL || _ide_run_get64(data) != sess->source_hash) {
+        log_message(LOG_DEBUG, "Patch for an unknown source, asking for the full source\r\n");
+        sess->resend = true;
+        libwebsocket_callback_on_writable(context, sess->wsi);
+        return 0;
+    }
+    
+    // Check the edits and size the result before touching anything
+    for(p = data + 8, pos = 0; p < end; p += 12 + ins) {
+        if(end - p < 12) {
+            return -1;
+        }
+        off = _ide_run_get32(p);
+        del = _ide_run_get32(p + 4);
+        ins = _ide_run_get32(p + 8);
+        if(off < pos || off > sess->source_len || del > sess->source_len - off || ins > (size_t) (end - p - 12)) {
+            return -1;
+        }
+        len += off - pos + ins;
+        pos = off + del;
+    }
+    len += sess->source_len - pos;
+    
+    if(len > (size_t) conf->max_script_size * 1024) {
+        log_message(LOG_WARNING, "Patched script larger than %d KB\r\n", conf->max_script_size);
+        return -1;
+    }
+    if((src = malloc(len > 0 ? len : 1)) == NULL) {
+        log_message(LOG_ERROR, "Could not allocate memory for a patched script\r\n");
+        return 0;
+    }
+    
+    for(p = data + 8, pos = 0, len = 0; p < end; p += 12 + ins) {
+        off = _ide_run_get32(p);
+        del = _ide_run_get32(p + 4);
+        ins = _ide_run_get32(p + 8);
+        memcpy(src + len, sess->source + pos, off - pos);
+        len += off - pos;
+        memcpy(src + len, p + 12, ins);
+        len += ins;
+        pos = off + del;
+    }
+    memcpy(src + len, sess->source + pos, sess->source_len - pos);
+    len += sess->source_len - pos;
+    
+    _ide_run_keep_source(sess, src, len);
+    _ide_run_stop(context, sess);
+    _ide_run_submit(context, sess, src, len);
+    return 0;
+}
+
+/**
+ * Send a frame with one or two 64 bit values. 
+ * @param context the websocket context. 
+ * @param wsi the websocket of the session. 
+ * @param type the frame type. 
+ * @param first the first value. 
+ * @param second the second value. 
+ * @param count the number of values. 
+ * @return 0 on success or -1 when the connection must be closed. 
+ */
+static int _ide_run_send_values(struct libwebsocket_context* context, struct libwebsocket* wsi, enum ide_run_message type, uint64_t first, uint64_t second, int count)
+{
+    unsigned char buf[LWS_SEND_BUFFER_PRE_PADDING + IDE_RUN_HEADER + 16 + LWS_SEND_BUFFER_POST_PADDING];
+    unsigned char* msg = buf + LWS_SEND_BUFFER_PRE_PADDING;
+    
+    _ide_run_header(msg, type, count * 8);
+    _ide_run_put64(msg + IDE_RUN_HEADER, first);
+    _ide_run_put64(msg + IDE_RUN_HEADER + 8, second);
+    if(libwebsocket_write(wsi, msg, IDE_RUN_HEADER + count * 8, LWS_WRITE_BINARY) < 0) {
+        return -1;
+    }
+    
+    // Output of a run may be waiting behind the frame
+    libwebsocket_callback_on_writable(context, wsi);
+    return 0;
+}
+
+/**
+ * Send the next frames of a run's log the connection hasn't seen. A reader 
+ * that fell behind the log is told where its output continues. 
+ * @param context the websocket context. 
+ * @param wsi the websocket of the session. 
+ * @param sess the ide-run session. 
+ * @param log the log of the run. 
+ * @return 0 on success or -1 when the connection must be closed. 
+ */
+static int _ide_run_send_log(struct libwebsocket_context* context, struct libwebsocket* wsi, struct ide_run_session* sess, const struct spill* log)
+{
+    unsigned char* frame = sess->frame + LWS_SEND_BUFFER_PRE_PADDING;
+    size_t n;
+    
+    if(sess->replay < spill_start(log)) {
+        sess->replay = spill_seek(log, sess->replay);
+        sess->announce = true;
+        libwebsocket_callback_on_writable(context, wsi);
+        return 0;
+    }
+    
+    n = _ide_run_frame_boundary(frame, spill_read(log, sess->replay, frame, DPT_WEB_IDE_OUTPUT_FRAME));
+    if(n == 0) {
+        log_message(LOG_ERROR, "Could not replay interpreter output from offset %llu\r\n", sess->replay);
+        sess->replay = log->end;
+    } else if(libwebsocket_write(wsi, frame, n, LWS_WRITE_BINARY) < 0) {
+        return -1;
+    } else if(sess->run != NULL) {
+        sess->run->frames++;
+    }
+    
+    sess->replay += n;
+    libwebsocket_callback_on_writable(context, wsi);
+    return 0;
+}
+
+/**
+ * Send a subscriber the output of the run it watches and the exit status 
+ * once the run is over. 
+ * @param context the websocket context. 
+ * @param wsi the websocket of the session. 
+ * @param sess the subscribed ide-run session. 
+ * @return 0 on success or -1 when the connection must be closed. 
+ */
+static int _ide_run_send_subscribed(struct libwebsocket_context* context, struct libwebsocket* wsi, struct ide_run_session* sess)
+{
+    struct ide_run* p = sess->producer;
+    unsigned char* frame = sess->frame + LWS_SEND_BUFFER_PRE_PADDING;
+    
+    if(sess->replay < p->log.end) {
+        return _ide_run_send_log(context, wsi, sess, &p->log);
+    }
+    
+    // The subscription ends with the status, once all output is in the log
+    if(p->proc.pid <= 0 && p->eof && p->output.used == 0) {
+        if(libwebsocket_write(wsi, frame, _ide_run_format_status(p, frame), LWS_WRITE_BINARY) < 0) {
+            return -1;
+        }
+        _ide_run_unsubscribe(sess);
     }
+    return 0;
+}
+
+/**
+ * Find a run with an output log. 
+ * @param id the run id. 
+ * @return the run or NULL when there is none with that id. 
+ */
+static struct ide_run* _ide_run_find(uint64_t id)
+{
+    struct ide_run* r;
+    
+    for(r = runs; r != NULL && r->run_id != id; r = r->next_run);
+    return r;
+}
+
+/**
+ * Timer handler stopping a detached run nobody came back for. 
+ * @param context the websocket context. 
+ * @param data the detached run. 
+ */
+static void _ide_run_expire(struct libwebsocket_context* context, void* data)
+{
+    struct ide_run* run = (struct ide_run*) data;
     
-    if(fputs(dmp, f) < 0) {
-        fclose(f);
-        log_message(LOG_ERROR, "Could not write to file %s\r\n", filename);
+    log_message(LOG_INFO, "Nobody resumed run %016llx, stopping it\r\n", (unsigned long long) run->run_id);
+    _ide_run_discard(context, run);
+}
+
+/**
+ * Keep the run of a closed connection going for the grace period so the 
+ * browser can resume it. 
+ * @param context the websocket context. 
+ * @param sess the ide-run session, it doesn't own the run afterwards. 
+ * @return true when the run was detached. 
+ */
+static bool _ide_run_detach(struct libwebsocket_context* context, struct ide_run_session* sess)
+{
+    struct ide_run* run = sess->run;
+    
+    // Only a run still going or with a status to tell is worth keeping
+    if(conf->detach_grace <= 0 || run == NULL || run->run_id == 0 || (run->proc.pid <= 0 && !run->exited)) {
         return false;
     }
     
-    fclose(f);
+    loop_timer_stop(&run->flush);
+    run->sess = NULL;
+    sess->run = NULL;
+    _ide_run_drain(run);
+    
+    loop_timer_start(&run->grace, conf->detach_grace * 1000, _ide_run_expire, run);
+    log_message(LOG_INFO, "Run %016llx detached for %d s\r\n", (unsigned long long) run->run_id, conf->detach_grace);
     return true;
 }
 
+/**
+ * Resume a detached run on this connection, replacing whatever it was 
+ * running. Output is replayed from the requested offset or the oldest 
+ * output still logged. 
+ * @param context the websocket context. 
+ * @param sess the ide-run session. 
+ * @param data the run id and output offset. 
+ * @param size the length of the data. 
+ * @return 0 on success or -1 when the message is malformed. 
+ */
+static int _ide_run_attach(struct libwebsocket_context* context, struct ide_run_session* sess, const unsigned char* data, size_t size)
+{
+    struct ide_run* run;
+    
+    if(size != 16) {
+        return -1;
+    }
+    
+    _ide_run_cancel(context, sess);
+    _ide_run_stop(context, sess);
+    sess->replay = 0;
+    sess->announce = true;
+    libwebsocket_callback_on_writable(context, sess->wsi);
+    
+    // An unknown run or one with a connection is answered with run id 0
+    if((run = _ide_run_find(_ide_run_get64(data))) == NULL || run->sess != NULL) {
+        log_message(LOG_DEBUG, "Can't resume unknown run %016llx\r\n", (unsigned long long) _ide_run_get64(data));
+        return 0;
+    }
+    if((sess->frame = pool_alloc(LWS_SEND_BUFFER_PRE_PADDING + DPT_WEB_IDE_OUTPUT_FRAME + LWS_SEND_BUFFER_POST_PADDING, &sess->frame_size)) == NULL) {
+        log_message(LOG_ERROR, "Could not allocate interpreter output buffers\r\n");
+        return 0;
+    }
+    
+    loop_timer_stop(&run->grace);
+    run->sess = sess;
+    sess->run = run;
+    if(run->input != NULL) {
+        libwebsocket_rx_flow_control(sess->wsi, 0);
+    }
+    
+    sess->replay = spill_seek(&run->log, _ide_run_get64(data + 8));
+    log_message(LOG_INFO, "Run %016llx resumed at output offset %llu\r\n", (unsigned long long) run->run_id, sess->replay);
+    return 0;
+}
+
+/**
+ * Watch the output of another connection's run, replacing whatever this 
+ * connection was running. Output is sent from the requested offset or the 
+ * oldest output still logged, at the pace of this connection. 
+ * @param context the websocket context. 
+ * @param sess the ide-run session. 
+ * @param data the run id and output offset. 
+ * @param size the length of the data. 
+ * @return 0 on success or -1 when the message is malformed. 
+ */
+static int _ide_run_subscribe(struct libwebsocket_context* context, struct ide_run_session* sess, const unsigned char* data, size_t size)
+{
+    struct ide_run* p;
+    
+    if(size != 16) {
+        return -1;
+    }
+    
+    _ide_run_cancel(context, sess);
+    _ide_run_stop(context, sess);
+    sess->replay = 0;
+    sess->announce = true;
+    libwebsocket_callback_on_writable(context, sess->wsi);
+    
+    // A run that can't be watched is answered with run id 0
+    if((p = _ide_run_find(_ide_run_get64(data))) == NULL || p->subscriber_count >= conf->run_subscribers) {
+        log_message(LOG_DEBUG, "Can't watch run %016llx\r\n", (unsigned long long) _ide_run_get64(data));
+        return 0;
+    }
+    if((sess->frame = pool_alloc(LWS_SEND_BUFFER_PRE_PADDING + DPT_WEB_IDE_OUTPUT_FRAME + LWS_SEND_BUFFER_POST_PADDING, &sess->frame_size)) == NULL) {
+        log_message(LOG_ERROR, "Could not allocate a send buffer for a subscriber\r\n");
+        return 0;
+    }
+    
+    sess->producer = p;
+    sess->next_subscriber = p->subscribers;
+    p->subscribers = sess;
+    p->subscriber_count++;
+    sess->replay = spill_seek(&p->log, _ide_run_get64(data + 8));
+    log_message(LOG_INFO, "Run %016llx has %d subscribers\r\n", (unsigned long long) p->run_id, p->subscriber_count);
+    
+    // From now on the output of the run goes through its log
+    _ide_run_schedule(context, p);
+    return 0;
+}
+
+/**
+ * Forget the fragments of an incomplete message. 
+ * @param sess the ide-run session. 
+ */
+static void _ide_run_drop_message(struct ide_run_session* sess)
+{
+    pool_release(sess->msg, sess->msg_size);
+    sess->msg = NULL;
+    sess->msg_len = 0;
+    sess->msg_size = 0;
+}
+
+/**
+ * Collect the fragments of a websocket message until it is complete. A 
+ * message that arrives in one piece is used in place. 
+ * @param wsi the websocket of the session. 
+ * @param sess the ide-run session. 
+ * @param in the fragment, the complete message on return. 
+ * @param len the length of the fragment, the message length on return. 
+ * @return 1 when the message is complete, 0 when more fragments follow 
+ *         and -1 when the message is too large. 
+ */
+static int _ide_run_reassemble(struct libwebsocket* wsi, struct ide_run_session* sess, void** in, size_t* len)
+{
+    size_t remaining = libwebsockets_remaining_packet_payload(wsi);
+    bool complete = remaining == 0 && libwebsocket_is_final_fragment(wsi);
+    size_t need = sess->msg_len + *len + remaining;
+    size_t size;
+    unsigned char* buf;
+    
+    if(complete && sess->msg == NULL) {
+        return 1;
+    }
+    
+    if(need > (size_t) conf->max_script_size * 1024) {
+        log_message(LOG_WARNING, "ide-run message larger than %d KB, closing the connection\r\n", conf->max_script_size);
+        _ide_run_drop_message(sess);
+        return -1;
+    }
+    
+    // Grow by doubling, the rest of the current fragment is known in advance
+    if(need > sess->msg_size) {
+        size = sess->msg_size * 2 > need ? sess->msg_size * 2 : need;
+        if((buf = pool_alloc(size, &size)) == NULL) {
+            log_message(LOG_ERROR, "Could not allocate memory for an ide-run message\r\n");
+            _ide_run_drop_message(sess);
+            return -1;
+        }
+        memcpy(buf, sess->msg, sess->msg_len);
+        pool_release(sess->msg, sess->msg_size);
+        sess->msg = buf;
+        sess->msg_size = size;
+    }
+    
+    memcpy(sess->msg + sess->msg_len, *in, *len);
+    sess->msg_len += *len;
+    if(!complete) {
+        return 0;
+    }
+    
+    *in = sess->msg;
+    *len = sess->msg_len;
+    return 1;
+}
+
+/**
+ * Handle the frames of a binary message from the browser. 
+ * @param context the websocket context. 
+ * @param sess the ide-run session. 
+ * @param data the message. 
+ * @param len the length of the message. 
+ * @return 0 on success or -1 when the message is malformed. 
+ */
+static int _ide_run_receive_frames(struct libwebsocket_context* context, struct ide_run_session* sess, const unsigned char* data, size_t len)
+{
+    size_t size;
+    
+    while(len > 0) {
+        if(len < IDE_RUN_HEADER || data[0] != IDE_RUN_VERSION || (size = _ide_run_get32(data + 2)) > len - IDE_RUN_HEADER) {
+            log_message(LOG_WARNING, "Malformed ide-run.v1 message, closing the connection\r\n");
+            return -1;
+        }
+        
+        switch(data[1]) {
+            case IDE_RUN_MSG_RUN:
+                _ide_run_full(context, sess, (const char*) data + IDE_RUN_HEADER, size);
+                break;
+                
+            case IDE_RUN_MSG_PATCH:
+                if(_ide_run_patch(context, sess, data + IDE_RUN_HEADER, size) < 0) {
+                    log_message(LOG_WARNING, "Malformed ide-run.v1 patch, closing the connection\r\n");
+                    return -1;
+                }
+                break;
+                
+            case IDE_RUN_MSG_ATTACH:
+                if(_ide_run_attach(context, sess, data + IDE_RUN_HEADER, size) < 0) {
+                    log_message(LOG_WARNING, "Malformed ide-run.v1 attach, closing the connection\r\n");
+                    return -1;
+                }
+                break;
+                
+            case IDE_RUN_MSG_WATCH:
+                if(_ide_run_subscribe(context, sess, data + IDE_RUN_HEADER, size) < 0) {
+                    log_message(LOG_WARNING, "Malformed ide-run.v1 watch, closing the connection\r\n");
+                    return -1;
+                }
+                break;
+                
+            case IDE_RUN_MSG_STOP:
+                _ide_run_cancel(context, sess);
+                if(sess->run != NULL) {
+                    _ide_run_kill(sess->run);
+                }
+                break;
+                
+            case IDE_RUN_MSG_STDIN:
+                _ide_run_input(sess, data + IDE_RUN_HEADER, size);
+                break;
+                
+            default:
+                log_message(LOG_DEBUG, "Ignoring ide-run.v1 frame of type %d\r\n", data[1]);
+                break;
+        }
+        
+        data += IDE_RUN_HEADER + size;
+        len -= IDE_RUN_HEADER + size;
+    }
+    
+    return 0;
+}
+
 /**
  * This handles ide_run protocol requests. 
  * @param context the context of the request. 
@@ -79,69 +1852,140 @@ static bool _dump_to_file(const char* dmp, const char* filename)
 int ide_run_callback(struct libwebsocket_context *context, struct libwebsocket *wsi, enum libwebsocket_callback_reasons reason, void *user, void *in, size_t len)
 {
     struct ide_run_session *sess = (struct ide_run_session*) user;
-    int b_read;
+    int n = 0;
     
     switch(reason) {
         case LWS_CALLBACK_ESTABLISHED:
             log_message(LOG_INFO, "ide-run websocket connection established\r\n");
+            sess->wsi = wsi;
+            if(++stats.sessions > stats.peak_sessions) {
+                stats.peak_sessions = stats.sessions;
+            }
             break;
         
         case LWS_CALLBACK_CLOSED:
-            log_message(LOG_INFO, "ide-run websocket connection closed\r\n");
-            if(sess->pid > 0) {
-                log_message(LOG_DEBUG, "Killing process: %d\r\n", (int) sess->pid);
-                process_stop(sess->pfstream, sess->pid);
-                sess->pid = -1;
-            }        
+            log_message(LOG_INFO, "ide-run websocket connection closed, it held at most %zu bytes\r\n", sess->peak);
+            _ide_run_drop_message(sess);
+            _ide_run_keep_source(sess, NULL, 0);
+            _ide_run_cancel(context, sess);
+            _ide_run_detach(context, sess);
+            _ide_run_stop(context, sess);
+            stats.sessions--;
             break;
             
         case LWS_CALLBACK_SERVER_WRITEABLE:
-            /* Forward the process output to the browser if any */
-            if(sess->pid > 0) {
-                errno = 0;
-                b_read = read(sess->pfd, sess->pbuff + LWS_SEND_BUFFER_PRE_PADDING, DPT_WEB_IDE_PROC_READ_BUFF - LWS_SEND_BUFFER_PRE_PADDING - LWS_SEND_BUFFER_POST_PADDING);
-                if(b_read == -1 && errno != EAGAIN) {
-                    // The read call failed, close
-                    log_message(LOG_ERROR, "Could not read from interpreter stdout: %s (pfd = %d)\r\n", strerror(errno), sess->pfd);
-                    return -1;
-                }
-                
-                if(b_read > 0) {
-                    libwebsocket_write(wsi, sess->pbuff + LWS_SEND_BUFFER_PRE_PADDING, b_read, LWS_WRITE_TEXT);
-                }
+            /* A patch that didn't apply is answered first */
+            if(sess->resend) {
+                sess->resend = false;
+                return _ide_run_send_values(context, wsi, IDE_RUN_MSG_RESEND, sess->source_hash, 0, 1);
+            }
+            
+            /* A detachable run tells its id and where its output continues */
+            if(sess->announce) {
+                sess->announce = false;
+                return _ide_run_send_values(context, wsi, IDE_RUN_MSG_ATTACHED, 
+                        sess->producer != NULL ? sess->producer->run_id : sess->run != NULL ? sess->run->run_id : 0, sess->replay, 2);
+            }
+            
+            /* A waiting run only gets its queue position */
+            if(sess->position > 0 && sess->position != sess->reported) {
+                return _ide_run_send_position(context, wsi, sess);
+            }
+            
+            /* A subscriber only gets the output of the run it watches */
+            if(sess->producer != NULL) {
+                return _ide_run_send_subscribed(context, wsi, sess);
+            }
+            
+            /* Logged output goes out first, after a reconnect or while the run is shared */
+            if(sess->run != NULL && sess->run->run_id != 0 && sess->replay < sess->run->log.end) {
+                return _ide_run_send_log(context, wsi, sess, &sess->run->log);
+            }
+            
+            /* Forward the buffered process output to the browser if any */
+            if(sess->run != NULL) {
+                return _ide_run_send(context, wsi, sess);
             }
             break;
             
         case LWS_CALLBACK_RECEIVE:     
-            if(strncmp("STOP", (const char*) in, 4) == 0) {
-                // Stop current process
-                if(sess->pid > 0) {
-                    log_message(LOG_DEBUG, "Killing process: %d\r\n", (int) sess->pid);
-                    process_stop(sess->pfstream, sess->pid);
-                    sess->pid = -1;
-                }
-            }else {
+            // Large scripts arrive in several fragments, only whole messages count
+            if((n = _ide_run_reassemble(wsi, sess, &in, &len)) <= 0) {
+                return n;
+            }
             
-                // Dump source code into file
-                _dump_to_file((const char*) in, "/tmp/dptwebide_tmp154968.js");
-
-                // Kill previous process if any
-                if(sess->pid > 0) {
-                    log_message(LOG_DEBUG, "Killing process: %d\r\n", (int) sess->pid);
-                    process_stop(sess->pfstream, sess->pid);
-                    sess->pid = -1;
+            n = 0;
+            if(sess->binary) {
+                n = _ide_run_receive_frames(context, sess, (const unsigned char*) in, len);
+            } else if(len >= 4 && strncmp("STOP", (const char*) in, 4) == 0) {
+                // A stopped run still reports its output and status, a waiting one is dropped
+                _ide_run_cancel(context, sess);
+                if(sess->run != NULL) {
+                    _ide_run_kill(sess->run);
                 }
-
-                // Open interpreter process and set to non blocking read
-                sess->pfstream = process_start("dpt-js /tmp/dptwebide_tmp154968.js 2>&1", &(sess->pid));
-                sess->pfd = fileno(sess->pfstream);
-                fcntl(sess->pfd, F_SETFL, O_NONBLOCK);
+            } else {
+                // Stop current process, a new script replaces it
+                _ide_run_stop(context, sess);
+                _ide_run_submit(context, sess, (const char*) in, len);
             }
-            break;
+            
+            // Scripts are copied by whoever keeps them
+            _ide_run_measure(sess);
+            _ide_run_drop_message(sess);
+            return n;
      
         default:
             break;
     }
     
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * This handles ide-run.v1 protocol requests, the framed binary version 
+ * of ide-run. 
+ * @param context the context of the request. 
+ * @param wsi the websocket currently used. 
+ * @param reason the callback reason. 
+ * @param user the user function. 
+ * @param in the in function. 
+ * @param len the length. 
+ * @return returns 0 on success or -1 on error.
+ */
+int ide_run_v1_callback(struct libwebsocket_context *context, struct libwebsocket *wsi, enum libwebsocket_callback_reasons reason, void *user, void *in, size_t len)
+{
+    struct ide_run_session *sess = (struct ide_run_session*) user;
+    
+    if(reason == LWS_CALLBACK_ESTABLISHED) {
+        sess->binary = true;
+    }
+    
+    return ide_run_callback(context, wsi, reason, user, in, len);
+}
+
+/**
+ * Stop the runs still waiting for their browser to reconnect. 
+ */
+void ide_run_free(void)
+{
+    struct ide_run* r = runs;
+    
+    while(r != NULL) {
+        if(r->sess != NULL) {
+            r = r->next_run;
+            continue;
+        }
+        _ide_run_discard(NULL, r);
+        r = runs;
+    }
+}
+
+/**
+ * Get the memory use of ide-run connections. 
+ * @param st filled with the statistics. 
+ */
+void ide_run_get_stats(struct ide_run_stats* st)
+{
+    *st = stats;
+    st->session_size = sizeof(struct ide_run_session);
+}
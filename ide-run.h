@@ -33,19 +33,138 @@
 
 #include <libwebsockets.h>
 #include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 #include "process.h"
 #include "config.h"
+#include "ring.h"
+#include "spill.h"
+#include "loop.h"
+#include "runq.h"
+
+/*
+ * The ide-run.v1 protocol sends binary websocket messages holding one or 
+ * more frames. A frame is a version byte, a type byte and a big endian 
+ * 32 bit payload length followed by the payload. 
+ */
+#define IDE_RUN_VERSION                 1                       // Version byte of every frame
+#define IDE_RUN_HEADER                  6                       // Frame header length
 
 /**
- * Session data for the ide-run protocol.
+ * ide-run.v1 frame types. 
+ */
+enum ide_run_message {
+    IDE_RUN_MSG_RUN = 0x01,             // Client: run the script in the payload
+    IDE_RUN_MSG_STOP = 0x02,            // Client: stop the run, no payload
+    IDE_RUN_MSG_STDIN = 0x03,           // Client: input for the program, an empty payload closes its stdin
+    IDE_RUN_MSG_PATCH = 0x04,           // Client: run the last source with edits, see below
+    IDE_RUN_MSG_ATTACH = 0x05,          // Client: resume a detached run, run id and output offset (u64)
+    IDE_RUN_MSG_WATCH = 0x06,           // Client: watch the output of another connection's run, run id and output offset (u64)
+    IDE_RUN_MSG_STDOUT = 0x81,          // Server: a chunk of stdout
+    IDE_RUN_MSG_STDERR = 0x82,          // Server: a chunk of stderr
+    IDE_RUN_MSG_EXIT = 0x83,            // Server: exit code, signal (s32), wall ms, user us, sys us, max RSS KB (u64)
+    IDE_RUN_MSG_STATS = 0x84,           // Server: queue position, runs running, runs waiting (u32), bytes forwarded, dropped (u64)
+    IDE_RUN_MSG_NOTICE = 0x85,          // Server: a message about the run in UTF-8
+    IDE_RUN_MSG_RESEND = 0x86,          // Server: a patch didn't match, hash of the source the server has (u64, 0 for none)
+    IDE_RUN_MSG_ATTACHED = 0x87         // Server: run id (u64, 0 for an unknown run) and the output offset sent next (u64)
+};
+
+/*
+ * A patch payload is the 64 bit FNV-1a hash of the source it applies to, 
+ * the source of the last run or patch, followed by edits in ascending 
+ * order. An edit is an offset, a number of bytes to delete and a number 
+ * of bytes to insert (u32 each) followed by the inserted bytes. 
+ *
+ * With a detach grace period configured every run gets an id, announced 
+ * in an attached frame. The run keeps going when the connection drops and 
+ * a new connection resumes it with an attach message. With sharing 
+ * configured other connections can watch a run by its id, each at its own 
+ * pace. A reader that falls behind the logged output gets a new attached 
+ * frame with the offset where it continues. Output offsets count the bytes 
+ * of the stdout, stderr and notice frames of a run. 
+ */
+
+struct ide_run_session;
+
+/**
+ * A run of the interpreter. It is taken from the buffer pool when a script 
+ * starts and returned once its output and status are delivered, or when 
+ * it is replaced or abandoned. 
+ */
+struct ide_run {
+    size_t alloc;                                       /* Allocated size of the run */
+    struct ide_run_session* sess;                       /* The connection of the run, NULL while detached */
+    bool binary;                                        /* The run speaks ide-run.v1 */
+    struct process proc;                                /* The interpreter process and its output pipes */
+    bool slot;                                          /* The run holds a run slot */
+    struct ring output;                                 /* Interpreter output waiting to be sent */
+    struct loop_timer flush;                            /* Sends output collected during a tick */
+    bool paused;                                        /* The output pipe is not read while the buffer is full */
+    bool killed;                                        /* The interpreter was stopped for overflowing its buffer */
+    bool eof;                                           /* The interpreter closed its output */
+    bool exited;                                        /* The interpreter exited, its status is not sent yet */
+    struct process_status status;                       /* How the interpreter ended */
+    unsigned long long forwarded;                       /* Output bytes sent to the browser */
+    unsigned long long dropped;                         /* Output bytes thrown away */
+    unsigned long long skipped;                         /* Dropped bytes not yet reported to the browser */
+    unsigned long frames;                               /* Websocket frames sent */
+    char* script;                                       /* Part of the script not yet piped to the interpreter */
+    size_t script_len;                                  /* Length of the piped script */
+    size_t script_sent;                                 /* Bytes of the piped script written to stdin */
+    int sfd;                                            /* The pipe the script is written to */
+    int ifd;                                            /* The stdin of the program, -1 when it carries the script */
+    char* input;                                        /* Program input not yet written to its stdin */
+    size_t input_len;                                   /* Length of the unwritten input */
+    bool input_eof;                                     /* Close stdin once the input is written */
+    char tmp_path[sizeof(DPT_WEB_IDE_SCRIPT_TMP)];      /* The script file in the file hand-off mode */
+    uint64_t run_id;                                    /* Id to resume or watch the run with, 0 without a log */
+    struct spill log;                                   /* Output of a detachable or shared run */
+    struct loop_timer grace;                            /* Stops a detached run nobody comes back for */
+    struct ide_run* next_run;                           /* Next run with an output log */
+    struct ide_run_session* subscribers;                /* Sessions watching this run */
+    int subscriber_count;                               /* Number of sessions watching this run */
+};
+
+/**
+ * Session data for the ide-run protocol, kept small as every connection 
+ * has one. 
  */
 struct ide_run_session {
-    pid_t pid;                                          /* The PID of the interpreter process */
-    FILE* pfstream;                                     /* The stdout filestream of the interpreter process */
-    int pfd;                                            /* The stdout file descriptor of the interpreter process */
-    unsigned char pbuff[DPT_WEB_IDE_PROC_READ_BUFF];    /* The output buffer of the interpreter process */
+    struct libwebsocket* wsi;                           /* The websocket of the session */
+    bool binary;                                        /* The session speaks ide-run.v1 */
+    bool resend;                                        /* The browser must be asked for the full source */
+    bool announce;                                      /* The run id and replay offset must be sent */
+    int position;                                       /* Position in the run queue, 0 when not waiting */
+    int reported;                                       /* Queue position last sent to the browser */
+    unsigned char* msg;                                 /* Fragments of an incomplete message, from the buffer pool */
+    size_t msg_len;                                     /* Bytes of the message received so far */
+    size_t msg_size;                                    /* Allocated size of the message buffer */
+    char* source;                                       /* Source of the last run, the base for patches */
+    size_t source_len;                                  /* Length of the last source */
+    uint64_t source_hash;                               /* FNV-1a hash of the last source */
+    struct runq_entry queue;                            /* Place in the run queue while waiting for a slot */
+    char* pending;                                      /* Script waiting for a run slot */
+    size_t pending_len;                                 /* Length of the waiting script */
+    struct ide_run* run;                                /* The run of the session, NULL when there is none */
+    struct ide_run* producer;                           /* The run this session watches, NULL when it doesn't */
+    struct ide_run_session* next_subscriber;            /* Next session watching the same run */
+    unsigned char* frame;                               /* Send buffer while running or watching, from the buffer pool */
+    size_t frame_size;                                  /* Allocated size of the send buffer */
+    unsigned long long replay;                          /* Log offset of the next output to send */
+    size_t peak;                                        /* Most memory the session held */
+};
+
+/**
+ * Memory use of ide-run connections. 
+ */
+struct ide_run_stats {
+    int sessions;                                       /* Connections open */
+    int peak_sessions;                                  /* Most connections open at once */
+    int runs;                                           /* Runs holding buffers, detached ones included */
+    size_t session_size;                                /* Memory of an idle connection */
+    size_t peak_footprint;                              /* Most memory one connection held */
 };
 
 /**
@@ -60,5 +179,29 @@ struct ide_run_session {
  */
 int ide_run_callback(struct libwebsocket_context *context, struct libwebsocket *wsi, enum libwebsocket_callback_reasons reason, void *user, void *in, size_t len);
 
+/**
+ * This handles ide-run.v1 protocol requests, the framed binary version 
+ * of ide-run. 
+ * @param context the context of the request. 
+ * @param wsi the websocket currently used. 
+ * @param reason the callback reason. 
+ * @param user the user function. 
+ * @param in the in function. 
+ * @param len the length. 
+ * @return returns 0 on success or -1 on error.
+ */
+int ide_run_v1_callback(struct libwebsocket_context *context, struct libwebsocket *wsi, enum libwebsocket_callback_reasons reason, void *user, void *in, size_t len);
+
+/**
+ * Stop the runs still waiting for their browser to reconnect. 
+ */
+void ide_run_free(void);
+
+/**
+ * Get the memory use of ide-run connections. 
+ * @param stats filled with the statistics. 
+ */
+void ide_run_get_stats(struct ide_run_stats* stats);
+
 #endif
 
@@ -0,0 +1,379 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   loop.c
+ * Created on October 17, 2026, 10:12 AM
+ */
+
+#include <libwebsockets.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+#include "loop.h"
+#include "config.h"
+#include "logger.h"
+
+/**
+ * What to do with a watched file descriptor. 
+ */
+struct loop_watch {
+    loop_handler handler;                               /* Handler, NULL for libwebsockets sockets */
+    void* data;                                         /* Handler data */
+};
+
+static struct pollfd* fds = NULL;                       /* The poll set */
+static struct loop_watch* watches = NULL;               /* Handlers, parallel to the poll set */
+static int* slots = NULL;                               /* Position in the poll set + 1 by descriptor */
+static struct pollfd* ready = NULL;                     /* Copy of the ready descriptors of one pass */
+static int fd_count = 0;                                /* Descriptors in the poll set */
+static int fd_max = 0;                                  /* Highest possible descriptor + 1 */
+static struct loop_timer* timers = NULL;                /* Running timers, soonest first */
+static struct loop_stats stats;                         /* Busy time of the loop */
+
+/**
+ * Initialize the event loop, must be called before the websocket 
+ * context is created. 
+ * @return true on success. 
+ */
+bool loop_init(void)
+{
+    long max = sysconf(_SC_OPEN_MAX);
+    
+    fd_max = max > 0 ? (int) max : 1024;
+    fds = calloc(fd_max, sizeof(struct pollfd));
+    watches = calloc(fd_max, sizeof(struct loop_watch));
+    slots = calloc(fd_max, sizeof(int));
+    ready = calloc(fd_max, sizeof(struct pollfd));
+    
+    if(fds == NULL || watches == NULL || slots == NULL || ready == NULL) {
+        log_message(LOG_ERROR, "Could not allocate the event loop for %d descriptors\r\n", fd_max);
+        loop_free();
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * Free the event loop. 
+ */
+void loop_free(void)
+{
+    free(fds);
+    free(watches);
+    free(slots);
+    free(ready);
+    fds = NULL;
+    watches = NULL;
+    slots = NULL;
+    ready = NULL;
+    fd_count = 0;
+}
+
+/**
+ * Watch a file descriptor. 
+ * @param fd the file descriptor. 
+ * @param events the poll events to wait for. 
+ * @param handler the handler to call, NULL for libwebsockets sockets. 
+ * @param data the data passed to the handler. 
+ * @return true on success. 
+ */
+bool loop_add(int fd, short events, loop_handler handler, void* data)
+{
+    int i;
+    
+    if(fd < 0 || fd >= fd_max) {
+        log_message(LOG_ERROR, "Can't watch file descriptor %d\r\n", fd);
+        return false;
+    }
+    
+    if(slots[fd] == 0) {
+        slots[fd] = ++fd_count;
+    }
+    
+    i = slots[fd] - 1;
+    fds[i].fd = fd;
+    fds[i].events = events;
+    fds[i].revents = 0;
+    watches[i].handler = handler;
+    watches[i].data = data;
+    return true;
+}
+
+/**
+ * Change the events a watched file descriptor waits for. 
+ * @param fd the file descriptor. 
+ * @param events the new poll events, 0 to pause the descriptor. 
+ */
+void loop_modify(int fd, short events)
+{
+    if(fd >= 0 && fd < fd_max && slots[fd] != 0) {
+        fds[slots[fd] - 1].events = events;
+    }
+}
+
+/**
+ * Stop watching a file descriptor, does nothing when it isn't watched. 
+ * @param fd the file descriptor. 
+ */
+void loop_remove(int fd)
+{
+    int i;
+    
+    if(fd < 0 || fd >= fd_max || slots[fd] == 0) {
+        return;
+    }
+    
+    /* Move the last descriptor into the hole */
+    i = slots[fd] - 1;
+    slots[fd] = 0;
+    if(i != --fd_count) {
+        fds[i] = fds[fd_count];
+        watches[i] = watches[fd_count];
+        slots[fds[i].fd] = i + 1;
+    }
+}
+
+/**
+ * Get the monotonic time used by timers. 
+ * @return the time in milliseconds. 
+ */
+long long loop_now(void)
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Get a monotonic time stamp for the busy time counters. 
+ * @return the time in microseconds. 
+ */
+static long long _loop_now_us(void)
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Account for the time a pass of the loop spent handling events. 
+ * @param start when the pass stopped waiting. 
+ */
+static void _loop_account(long long start)
+{
+    long long busy = _loop_now_us() - start;
+    
+    stats.passes++;
+    stats.busy_us += busy;
+    if(busy > stats.max_busy_us) {
+        stats.max_busy_us = busy;
+    }
+    if(busy > DPT_WEB_IDE_STALL_MS * 1000) {
+        stats.stalls++;
+    }
+}
+
+/**
+ * Start a timer, a running timer is restarted. 
+ * @param t the timer. 
+ * @param ms the time until it expires in milliseconds. 
+ * @param handler the handler to call. 
+ * @param data the data passed to the handler. 
+ */
+void loop_timer_start(struct loop_timer* t, int ms, loop_timer_handler handler, void* data)
+{
+    struct loop_timer** pos = &timers;
+    
+    loop_timer_stop(t);
+    t->due = loop_now() + ms;
+    t->handler = handler;
+    t->data = data;
+    t->armed = true;
+    
+    /* Keep the list ordered on expiry time */
+    while(*pos != NULL && (*pos)->due <= t->due) {
+        pos = &(*pos)->next;
+    }
+    t->next = *pos;
+    *pos = t;
+}
+
+/**
+ * Stop a timer, does nothing when it isn't running. 
+ * @param t the timer. 
+ */
+void loop_timer_stop(struct loop_timer* t)
+{
+    struct loop_timer** pos = &timers;
+    
+    if(!t->armed) {
+        return;
+    }
+    
+    while(*pos != t) {
+        pos = &(*pos)->next;
+    }
+    *pos = t->next;
+    t->next = NULL;
+    t->armed = false;
+}
+
+/**
+ * Call the handlers of expired timers. 
+ * @param context the websocket context. 
+ * @return the number of handlers called. 
+ */
+static int _loop_run_timers(struct libwebsocket_context* context)
+{
+    long long now = loop_now();
+    struct loop_timer* t;
+    int n = 0;
+    
+    /* Handlers may start and stop timers, take them off the list first */
+    while((t = timers) != NULL && t->due <= now) {
+        timers = t->next;
+        t->next = NULL;
+        t->armed = false;
+        t->handler(context, t->data);
+        n++;
+    }
+    return n;
+}
+
+/**
+ * Handle the libwebsockets external poll callbacks. 
+ * @param reason the callback reason. 
+ * @param in the callback argument. 
+ */
+void loop_lws_callback(enum libwebsocket_callback_reasons reason, void* in)
+{
+    struct libwebsocket_pollargs* pa = (struct libwebsocket_pollargs*) in;
+    
+    switch(reason) {
+        case LWS_CALLBACK_ADD_POLL_FD:
+            loop_add(pa->fd, pa->events, NULL, NULL);
+            break;
+            
+        case LWS_CALLBACK_DEL_POLL_FD:
+            loop_remove(pa->fd);
+            break;
+            
+        case LWS_CALLBACK_CHANGE_MODE_POLL_FD:
+            loop_modify(pa->fd, pa->events);
+            break;
+            
+        default:
+            break;
+    }
+}
+
+/**
+ * Wait for events once and dispatch them. 
+ * @param context the websocket context. 
+ * @param timeout_ms the longest time to wait. 
+ * @return 0 on success or -1 on a fatal error. 
+ */
+int loop_run(struct libwebsocket_context* context, int timeout_ms)
+{
+    struct libwebsocket_pollfd pfd;
+    long long start;
+    int n, i, count = 0;
+    
+    /* Wake up in time for the first timer */
+    if(timers != NULL) {
+        long long wait = timers->due - loop_now();
+        if(timeout_ms < 0 || wait < timeout_ms) {
+            timeout_ms = wait > 0 ? (int) wait : 0;
+        }
+    }
+    
+    n = poll(fds, fd_count, timeout_ms);
+    if(n < 0) {
+        if(errno == EINTR) {
+            return 0;
+        }
+        log_message(LOG_ERROR, "poll() failed: %s\r\n", strerror(errno));
+        return -1;
+    }
+    start = _loop_now_us();
+    
+    /* Handlers add and remove descriptors, work on a copy of the ready ones */
+    for(i = 0; i < fd_count && count < n; ++i) {
+        if(fds[i].revents) {
+            ready[count++] = fds[i];
+        }
+    }
+    
+    /* Let libwebsockets handle its timeouts even when nothing happened */
+    if(libwebsocket_service_fd(context, NULL) < 0) {
+        return -1;
+    }
+    
+    for(i = 0; i < count; ++i) {
+        /* Skip descriptors removed by an earlier handler of this pass */
+        if(slots[ready[i].fd] == 0) {
+            continue;
+        }
+        
+        n = slots[ready[i].fd] - 1;
+        if(watches[n].handler != NULL) {
+            watches[n].handler(context, ready[i].fd, ready[i].revents, watches[n].data);
+            continue;
+        }
+        
+        pfd.fd = ready[i].fd;
+        pfd.events = ready[i].events;
+        pfd.revents = ready[i].revents;
+        if(libwebsocket_service_fd(context, &pfd) < 0) {
+            return -1;
+        }
+    }
+    
+    count += _loop_run_timers(context);
+    
+    // Only passes that did something say how long clients may wait for the loop
+    if(count > 0) {
+        _loop_account(start);
+    }
+    return 0;
+}
+
+/**
+ * Get the busy time counters of the event loop. 
+ * @param st filled with the counters. 
+ */
+void loop_get_stats(struct loop_stats* st)
+{
+    *st = stats;
+}
@@ -0,0 +1,152 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   loop.h
+ * Created on October 17, 2026, 10:12 AM
+ */
+
+#ifndef LOOP_H
+#define	LOOP_H
+
+#include <libwebsockets.h>
+#include <stdbool.h>
+
+/**
+ * Called when a watched file descriptor is ready. 
+ * @param context the websocket context. 
+ * @param fd the ready file descriptor. 
+ * @param revents the poll events that occurred. 
+ * @param data the data given when the descriptor was added. 
+ */
+typedef void (*loop_handler)(struct libwebsocket_context* context, int fd, short revents, void* data);
+
+/**
+ * Called when a timer expires. 
+ * @param context the websocket context. 
+ * @param data the data given when the timer was started. 
+ */
+typedef void (*loop_timer_handler)(struct libwebsocket_context* context, void* data);
+
+/**
+ * A one-shot timer, embedded in the structure that owns it. 
+ */
+struct loop_timer {
+    long long due;                                      /* Expiry time in ms, see loop_now() */
+    loop_timer_handler handler;                         /* Handler to call */
+    void* data;                                         /* Handler data */
+    struct loop_timer* next;                            /* Next timer to expire */
+    bool armed;                                         /* True while the timer is waiting */
+};
+
+/**
+ * How long the event loop was busy between waits. 
+ */
+struct loop_stats {
+    unsigned long passes;                               /* Passes that handled events */
+    unsigned long long busy_us;                         /* Time spent handling events */
+    long long max_busy_us;                              /* Longest pass */
+    unsigned long stalls;                               /* Passes longer than DPT_WEB_IDE_STALL_MS */
+};
+
+/**
+ * Initialize the event loop, must be called before the websocket 
+ * context is created. 
+ * @return true on success. 
+ */
+bool loop_init(void);
+
+/**
+ * Free the event loop. 
+ */
+void loop_free(void);
+
+/**
+ * Watch a file descriptor. 
+ * @param fd the file descriptor. 
+ * @param events the poll events to wait for. 
+ * @param handler the handler to call, NULL for libwebsockets sockets. 
+ * @param data the data passed to the handler. 
+ * @return true on success. 
+ */
+bool loop_add(int fd, short events, loop_handler handler, void* data);
+
+/**
+ * Change the events a watched file descriptor waits for. 
+ * @param fd the file descriptor. 
+ * @param events the new poll events, 0 to pause the descriptor. 
+ */
+void loop_modify(int fd, short events);
+
+/**
+ * Stop watching a file descriptor, does nothing when it isn't watched. 
+ * @param fd the file descriptor. 
+ */
+void loop_remove(int fd);
+
+/**
+ * Get the monotonic time used by timers. 
+ * @return the time in milliseconds. 
+ */
+long long loop_now(void);
+
+/**
+ * Start a timer, a running timer is restarted. 
+ * @param t the timer. 
+ * @param ms the time until it expires in milliseconds. 
+ * @param handler the handler to call. 
+ * @param data the data passed to the handler. 
+ */
+void loop_timer_start(struct loop_timer* t, int ms, loop_timer_handler handler, void* data);
+
+/**
+ * Stop a timer, does nothing when it isn't running. 
+ * @param t the timer. 
+ */
+void loop_timer_stop(struct loop_timer* t);
+
+/**
+ * Handle the libwebsockets external poll callbacks. 
+ * @param reason the callback reason. 
+ * @param in the callback argument. 
+ */
+void loop_lws_callback(enum libwebsocket_callback_reasons reason, void* in);
+
+/**
+ * Wait for events once and dispatch them. 
+ * @param context the websocket context. 
+ * @param timeout_ms the longest time to wait. 
+ * @return 0 on success or -1 on a fatal error. 
+ */
+int loop_run(struct libwebsocket_context* context, int timeout_ms);
+
+/**
+ * Get the busy time counters of the event loop. 
+ * @param st filled with the counters. 
+ */
+void loop_get_stats(struct loop_stats* st);
+
+#endif
+
@@ -39,6 +39,16 @@
 
 #include "config.h"
 #include "logger.h"
+#include "cache.h"
+#include "bundle.h"
+#include "upload.h"
+#include "pool.h"
+#include "loop.h"
+#include "warm.h"
+#include "process.h"
+#include "runq.h"
+#include "worker.h"
+#include "offload.h"
 #include "main.h"
 
 /* Flag denoting a forced exit */
@@ -53,9 +63,22 @@ static struct libwebsocket_context *context;
  */
 static void sighandler(int sig) {
     force_exit = 1;
+    worker_stop();
     libwebsocket_cancel_service(context);
 }
 
+/**
+ * Event loop handler for changes in the HTML tree. 
+ * @param context the websocket context. 
+ * @param fd the inotify file descriptor. 
+ * @param revents the poll events that occurred. 
+ * @param data unused. 
+ */
+static void _main_cache_changed(struct libwebsocket_context* context, int fd, short revents, void* data)
+{
+    cache_poll();
+}
+
 /**
  * DPT-Web IDE server main entry point. 
  * @param argc argument count. 
@@ -65,6 +88,14 @@ static void sighandler(int sig) {
 int main(int argc, char** argv)
 {
     struct lws_context_creation_info info;
+    struct cache_stats cstats;
+    struct upload_stats ustats;
+    struct pool_stats pstats;
+    struct warm_stats wstats;
+    struct runq_stats rstats;
+    struct ide_run_stats istats;
+    struct loop_stats lstats;
+    struct offload_stats ostats;
     int n = 0;
     int cur_fd;
     
@@ -104,8 +135,16 @@ int main(int argc, char** argv)
     /* Register the signal handler for interruption */
     signal(SIGINT, sighandler);
     
-    /* Ignore child (interpreter) exits so they don't become zombie */
-    signal(SIGCHLD, SIG_IGN);
+    /* Writes to a closed socket (sendfile) must fail with EPIPE instead of killing us */
+    signal(SIGPIPE, SIG_IGN);
+    
+    /* The event loop must exist before libwebsockets adds its sockets */
+    if(!loop_init()) {
+        return EXIT_FAILURE;
+    }
+    
+    /* Connection buffers are recycled through a shared pool */
+    pool_init((size_t) conf->pool_size * 1024);
     
     /* Initialize libwebsockets context */
     memset(&info, 0, sizeof(info));
@@ -127,17 +166,88 @@ int main(int argc, char** argv)
         log_message(LOG_INFO, "Succesfully created libwebsocket context\r\n");
     }
     
-    /* Start the main eventloop */
+    /* Workers share the listen socket and the run cap, each serves the connections it accepts with its own state */
+    if(conf->workers > 1 && worker_start(conf->workers, conf->max_runs) < 0) {
+        libwebsocket_context_destroy(context);
+        loop_free();
+        pool_free_all();
+        log_message(LOG_INFO, "dpt-web-ide server exited cleanly\r\n");
+        return EXIT_SUCCESS;
+    }
+    
+    /* Interpreters are reaped from the event loop so their exit status is known */
+    if(!process_init()) {
+        return EXIT_FAILURE;
+    }
+    
+    /* Disk writes that must reach the platter and file reads run on I/O threads */
+    if(!offload_init(conf->io_threads, conf->io_uring)) {
+        return EXIT_FAILURE;
+    }
+    
+    /* Serve the IDE from a packed bundle or cache the files of the HTML tree */
+    if(conf->bundle_path[0] == '\0' || !bundle_open(conf->bundle_path)) {
+        cache_init(conf->html_path, (size_t) conf->cache_size * 1024, (size_t) conf->compress_cache_size * 1024);
+    }
+    
+    /* Zero-copy transfers are only possible on unencrypted connections */
+    http_init(conf->sendfile && info.ssl_cert_filepath == NULL);
+    
+    /* Cap the number of interpreters running at once over all workers */
+    runq_init(conf->max_runs);
+    
+    /* Keep interpreters ready so a Run doesn't wait for one to start, the pool is split over the workers */
+    warm_init(worker_share(conf->warm_pool_size), conf->warm_pool_ttl);
+    
+    /* Invalidate cached files as soon as they change on disk */
+    if(cache_get_fd() >= 0) {
+        loop_add(cache_get_fd(), POLLIN, _main_cache_changed, NULL);
+    }
+    
+    /* Start the main eventloop, sockets and interpreter pipes share one poll set */
     while(n >= 0 && !force_exit) {
-        /* Run the and ide-run process service */
-        libwebsocket_callback_on_writable_all_protocol(&protocols[PROTO_IDE_RUN]);
-        
-        /* Run the websocket service */
-        n = libwebsocket_service(context, DPT_WEB_IDE_WEBSOCK_TIMOUT);
+        n = loop_run(context, DPT_WEB_IDE_WEBSOCK_TIMOUT);
     }
     
     /* Close program */
+    warm_get_stats(&wstats);
+    log_message(LOG_INFO, "Interpreter pool: %lu hits, %lu misses (%.0f%% hit rate), %lu started in %llu us on average, %lu recycled, %lu died\r\n", 
+            wstats.hits, wstats.misses, wstats.hits + wstats.misses ? 100.0 * wstats.hits / (wstats.hits + wstats.misses) : 0.0, 
+            wstats.spawned, wstats.spawned ? wstats.spawn_us / wstats.spawned : 0, wstats.recycled, wstats.died);
+    warm_free();
+    runq_get_stats(&rstats);
+    log_message(LOG_INFO, "Run queue: %lu runs started, %lu waited %llu ms on average, longest queue %d\r\n", 
+            rstats.admitted, rstats.queued, rstats.queued ? rstats.wait_ms / rstats.queued : 0, rstats.peak_waiting);
     libwebsocket_context_destroy(context);
+    ide_run_free();
+    ide_run_get_stats(&istats);
+    log_message(LOG_INFO, "ide-run connections: %d at most, %zu bytes each while idle, %zu bytes at most for one connection\r\n", 
+            istats.peak_sessions, istats.session_size, istats.peak_footprint);
+    offload_free();
+    offload_get_stats(&ostats);
+    log_message(LOG_INFO, "I/O threads: %lu jobs, %llu us of work on average, %lld us at most, done %llu us after submitting on average, longest queue %d\r\n", 
+            ostats.jobs, ostats.jobs ? ostats.work_us / ostats.jobs : 0, ostats.max_work_us, 
+            ostats.jobs ? ostats.latency_us / ostats.jobs : 0, ostats.peak_waiting);
+    log_message(LOG_INFO, "io_uring: %lu reads in %lu submissions\r\n", ostats.ring_jobs, ostats.submits);
+    process_free();
+    loop_get_stats(&lstats);
+    log_message(LOG_INFO, "Event loop: %lu busy passes, %llu us on average, %lld us at most, %lu over %d ms\r\n", 
+            lstats.passes, lstats.passes ? lstats.busy_us / lstats.passes : 0, lstats.max_busy_us, lstats.stalls, DPT_WEB_IDE_STALL_MS);
+    loop_free();
+    
+    cache_get_stats(&cstats);
+    log_message(LOG_INFO, "Static asset cache: %lu hits, %lu misses, %lu evictions, %lu invalidations, %lu compressions\r\n", 
+            cstats.hits, cstats.misses, cstats.evictions, cstats.invalidations, cstats.compressions);
+    cache_free();
+    bundle_close();
+    
+    pool_get_stats(&pstats);
+    log_message(LOG_INFO, "Buffer pool: %lu allocations, %lu reused\r\n", pstats.allocs, pstats.reuses);
+    pool_free_all();
+    
+    upload_get_stats(&ustats);
+    log_message(LOG_INFO, "Uploads: %lu stored, %lu failed, %llu bytes at %.1f KB/s\r\n", 
+            ustats.completed, ustats.failed, ustats.bytes, ustats.seconds > 0 ? ustats.bytes / 1024.0 / ustats.seconds : 0.0);
     log_message(LOG_INFO, "dpt-web-ide server exited cleanly\r\n");
     
     return EXIT_SUCCESS;
@@ -39,7 +39,8 @@
  */
 enum protocols {
     PROTO_HTTP = 0,
-    PROTO_IDE_RUN
+    PROTO_IDE_RUN,
+    PROTO_IDE_RUN_V1
 };
 
 /**
@@ -58,6 +59,12 @@ static struct libwebsocket_protocols protocols[] = {
         sizeof(struct ide_run_session),
         0
     },
+    {
+        "ide-run.v1",
+        ide_run_v1_callback,
+        sizeof(struct ide_run_session),
+        0
+    },
     {
         NULL, NULL, 0, 0
     }
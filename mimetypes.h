@@ -39,24 +39,32 @@
 struct mimetype {
     const char *extn;
     const char *mime;
+    const char *cache_control;      /* Cache-Control policy, NULL for DPT_WEB_IDE_CACHE_CONTROL */
 };
 
 /**
- * All supprted filetypes 
+ * All supprted filetypes. Fingerprinted bundles can be marked with 
+ * "public, max-age=31536000, immutable" so browsers never revalidate them.
+ * Extra types are added at runtime with 'mimetype <ext> <type> [policy]'
+ * lines in the configuration file. 
  */
 static const struct mimetype mime_types[] = {
-    { "js",      "text/javascript" },
-    { "css",     "text/css" },
-    { "html",    "text/html" },
-    { "json",    "application/json" },
-    { "ico",     "image/x-icon" },
-    { "mp3",     "audio/mpeg" },
-    { "woff",    "application/font-woff" },
+    { "js",      "text/javascript",         NULL },
+    { "css",     "text/css",                NULL },
+    { "html",    "text/html",               NULL },
+    { "json",    "application/json",        NULL },
+    { "map",     "application/json",        NULL },
+    { "txt",     "text/plain",              NULL },
+    { "svg",     "image/svg+xml",           "public, max-age=86400" },
+    { "wasm",    "application/wasm",        NULL },
+    { "ico",     "image/x-icon",            "public, max-age=86400" },
+    { "mp3",     "audio/mpeg",              "public, max-age=86400" },
+    { "woff",    "application/font-woff",   "public, max-age=86400" },
 
-    { "png",     "image/png" },
-    { "jpg",     "image/jpeg" },
+    { "png",     "image/png",               "public, max-age=86400" },
+    { "jpg",     "image/jpeg",              "public, max-age=86400" },
 
-    { NULL, NULL }
+    { NULL, NULL, NULL }
 };
 
 #endif
\ No newline at end of file
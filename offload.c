@@ -0,0 +1,628 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   offload.c
+ * Created on October 17, 2026, 8:50 PM
+ */
+
+#define _GNU_SOURCE
+
+#include <libwebsockets.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "offload.h"
+#include "config.h"
+#include "logger.h"
+#include "loop.h"
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_t* threads = NULL;                       /* The I/O threads */
+static int thread_count = 0;                            /* Number of I/O threads */
+static struct offload_job* waiting = NULL;              /* Jobs waiting for a thread, oldest first */
+static struct offload_job** waiting_tail = &waiting;    /* End of the waiting list */
+static int waiting_count = 0;                           /* Jobs on the waiting list */
+static struct offload_job* finished = NULL;             /* Jobs waiting for completion, oldest first */
+static struct offload_job** finished_tail = &finished;  /* End of the finished list */
+static bool stopping = false;                           /* The threads must stop once the queue is empty */
+static int event_fd = -1;                               /* Wakes the event loop when a job finished */
+static struct offload_stats stats;
+
+#ifdef HAVE_IO_URING
+/**
+ * An io_uring driven through the raw system calls, only used from the 
+ * event loop. 
+ */
+struct offload_ring {
+    int fd;                                             /* The ring, -1 when reads go to the threads */
+    void* sq;                                           /* Mapped submission ring */
+    size_t sq_size;                                     /* Size of that mapping */
+    void* cq;                                           /* Mapped completion ring, can be the submission ring */
+    size_t cq_size;                                     /* Size of that mapping */
+    struct io_uring_sqe* sqes;                          /* Mapped submission entries */
+    size_t sqes_size;                                   /* Size of that mapping */
+    unsigned* sq_head;                                  /* First entry the kernel didn't consume yet */
+    unsigned* sq_tail;                                  /* Where the next entry goes */
+    unsigned* sq_mask;                                  /* Submission ring index mask */
+    unsigned* sq_array;                                 /* Submission ring slots */
+    unsigned sq_entries;                                /* Submission ring size */
+    unsigned* cq_head;                                  /* First unhandled completion */
+    unsigned* cq_tail;                                  /* End of the completions */
+    unsigned* cq_mask;                                  /* Completion ring index mask */
+    struct io_uring_cqe* cqes;                          /* Completion entries */
+    unsigned cq_entries;                                /* Completion ring size */
+    unsigned queued;                                    /* Entries not submitted yet */
+    unsigned inflight;                                  /* Entries without completion */
+    struct loop_timer flush;                            /* Submits the queued entries at the end of a loop pass */
+};
+
+static struct offload_ring ring = { .fd = -1 };
+#endif
+
+/**
+ * Get a monotonic time stamp for the job counters. 
+ * @return the time in microseconds. 
+ */
+static long long _offload_now_us(void)
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Do the work of a job and hand it to the event loop for completion. 
+ * @param job the job. 
+ */
+static void _offload_run(struct offload_job* job)
+{
+    uint64_t one = 1;
+    long long start = _offload_now_us();
+    
+    // A read has no work function, it is the same read the ring would do
+    if(job->work != NULL) {
+        job->work(job->data);
+    } else if((job->result = pread(job->fd, job->iov.iov_base, job->iov.iov_len, job->offset)) < 0) {
+        job->result = -errno;
+    }
+    job->work_us = _offload_now_us() - start;
+    
+    pthread_mutex_lock(&lock);
+    job->next = NULL;
+    *finished_tail = job;
+    finished_tail = &job->next;
+    pthread_mutex_unlock(&lock);
+    
+    // A full counter still wakes the loop, nothing is lost when this fails
+    if(write(event_fd, &one, sizeof(one)) < 0) {
+        return;
+    }
+}
+
+/**
+ * Main function of an I/O thread, runs jobs until the pool stops. 
+ * @param arg unused. 
+ * @return NULL. 
+ */
+static void* _offload_thread(void* arg)
+{
+    struct offload_job* job;
+    
+    pthread_mutex_lock(&lock);
+    for(;;) {
+        while(waiting == NULL && !stopping) {
+            pthread_cond_wait(&wake, &lock);
+        }
+        if(waiting == NULL) {
+            break;
+        }
+        
+        job = waiting;
+        if((waiting = job->next) == NULL) {
+            waiting_tail = &waiting;
+        }
+        waiting_count--;
+        pthread_mutex_unlock(&lock);
+        
+        _offload_run(job);
+        
+        pthread_mutex_lock(&lock);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+/**
+ * Call the completion handlers of the finished jobs, in the order the 
+ * work finished. 
+ * @param context the websocket context. 
+ */
+static void _offload_complete(struct libwebsocket_context* context)
+{
+    struct offload_job* job;
+    struct offload_job* next;
+    long long now = _offload_now_us();
+    
+    pthread_mutex_lock(&lock);
+    job = finished;
+    finished = NULL;
+    finished_tail = &finished;
+    pthread_mutex_unlock(&lock);
+    
+    for(; job != NULL; job = next) {
+        next = job->next;
+        stats.jobs++;
+        stats.work_us += job->work_us;
+        stats.latency_us += now - job->queued_us;
+        if(job->work_us > stats.max_work_us) {
+            stats.max_work_us = job->work_us;
+        }
+        job->done(context, job->data);
+    }
+}
+
+#ifdef HAVE_IO_URING
+/**
+ * Hand the queued reads to the kernel in one system call. 
+ * @return true when all queued reads are submitted. 
+ */
+static bool _offload_ring_submit(void)
+{
+    int n;
+    
+    if(ring.queued == 0) {
+        return true;
+    }
+    
+    if((n = syscall(__NR_io_uring_enter, ring.fd, ring.queued, 0, 0, NULL, 0)) < 0) {
+        if(errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            log_message(LOG_ERROR, "Could not submit to io_uring: %s\r\n", strerror(errno));
+        }
+        return false;
+    }
+    
+    ring.queued -= n;
+    stats.submits++;
+    return ring.queued == 0;
+}
+
+/**
+ * Loop timer handler that submits the reads queued during the pass. 
+ * @param context the websocket context. 
+ * @param data unused. 
+ */
+static void _offload_ring_flush(struct libwebsocket_context* context, void* data)
+{
+    // The kernel is short on resources, try again shortly
+    if(!_offload_ring_submit()) {
+        loop_timer_start(&ring.flush, 1, _offload_ring_flush, NULL);
+    }
+}
+
+/**
+ * Queue a read on the ring, it is submitted at the end of the loop pass. 
+ * @param job the read. 
+ * @return true when queued, false when the ring can't take it. 
+ */
+static bool _offload_ring_read(struct offload_job* job)
+{
+    struct io_uring_sqe* sqe;
+    unsigned tail, index;
+    
+    // Never have more reads in flight than the completion ring holds
+    if(ring.fd < 0 || ring.inflight >= ring.cq_entries) {
+        return false;
+    }
+    
+    tail = *ring.sq_tail;
+    if(tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) >= ring.sq_entries) {
+        return false;
+    }
+    
+    index = tail & *ring.sq_mask;
+    sqe = &ring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = job->fd;
+    sqe->addr = (uintptr_t) &job->iov;
+    sqe->len = 1;
+    sqe->off = job->offset;
+    sqe->user_data = (uintptr_t) job;
+    ring.sq_array[index] = index;
+    __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    
+    ring.queued++;
+    ring.inflight++;
+    
+    // A full submission ring goes out now, otherwise at the end of the pass
+    if(ring.queued == ring.sq_entries) {
+        _offload_ring_submit();
+    }
+    if(ring.queued > 0 && !ring.flush.armed) {
+        loop_timer_start(&ring.flush, 0, _offload_ring_flush, NULL);
+    }
+    return true;
+}
+
+/**
+ * Call the completion handlers of the finished ring reads. 
+ * @param context the websocket context. 
+ */
+static void _offload_ring_reap(struct libwebsocket_context* context)
+{
+    struct io_uring_cqe* cqe;
+    struct offload_job* job;
+    long long now = _offload_now_us();
+    unsigned head;
+    
+    if(ring.fd < 0) {
+        return;
+    }
+    
+    head = *ring.cq_head;
+    while(head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+        cqe = &ring.cqes[head & *ring.cq_mask];
+        job = (struct offload_job*) (uintptr_t) cqe->user_data;
+        job->result = cqe->res;
+        
+        // Free the entry first, the handler may queue the next read
+        __atomic_store_n(ring.cq_head, ++head, __ATOMIC_RELEASE);
+        ring.inflight--;
+        
+        stats.jobs++;
+        stats.ring_jobs++;
+        stats.latency_us += now - job->queued_us;
+        job->done(context, job->data);
+    }
+}
+
+/**
+ * Unmap and close the ring. 
+ */
+static void _offload_ring_close(void)
+{
+    if(ring.sqes != NULL) {
+        munmap(ring.sqes, ring.sqes_size);
+    }
+    if(ring.cq != NULL && ring.cq != ring.sq) {
+        munmap(ring.cq, ring.cq_size);
+    }
+    if(ring.sq != NULL) {
+        munmap(ring.sq, ring.sq_size);
+    }
+    if(ring.fd >= 0) {
+        close(ring.fd);
+    }
+    memset(&ring, 0, sizeof(ring));
+    ring.fd = -1;
+}
+
+/**
+ * Set up the ring, reads fall back to the I/O threads when the kernel has 
+ * no io_uring or doesn't allow it. 
+ * @return true when reads go through the ring. 
+ */
+static bool _offload_ring_setup(void)
+{
+    struct io_uring_params p;
+    unsigned char* sq;
+    unsigned char* cq;
+    
+    memset(&p, 0, sizeof(p));
+    if((ring.fd = syscall(__NR_io_uring_setup, DPT_WEB_IDE_URING_ENTRIES, &p)) < 0) {
+        log_message(LOG_INFO, "io_uring is not available (%s), files are read on the I/O threads\r\n", strerror(errno));
+        ring.fd = -1;
+        return false;
+    }
+    
+    ring.sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring.cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring.sq_size = ring.cq_size = ring.sq_size > ring.cq_size ? ring.sq_size : ring.cq_size;
+    }
+    ring.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    
+    ring.sq = mmap(NULL, ring.sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    if(ring.sq == MAP_FAILED) {
+        ring.sq = NULL;
+        goto error;
+    }
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring.cq = ring.sq;
+    } else if((ring.cq = mmap(NULL, ring.cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING)) == MAP_FAILED) {
+        ring.cq = NULL;
+        goto error;
+    }
+    ring.sqes = mmap(NULL, ring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if(ring.sqes == MAP_FAILED) {
+        ring.sqes = NULL;
+        goto error;
+    }
+    
+    sq = ring.sq;
+    cq = ring.cq;
+    ring.sq_head = (unsigned*) (sq + p.sq_off.head);
+    ring.sq_tail = (unsigned*) (sq + p.sq_off.tail);
+    ring.sq_mask = (unsigned*) (sq + p.sq_off.ring_mask);
+    ring.sq_array = (unsigned*) (sq + p.sq_off.array);
+    ring.sq_entries = p.sq_entries;
+    ring.cq_head = (unsigned*) (cq + p.cq_off.head);
+    ring.cq_tail = (unsigned*) (cq + p.cq_off.tail);
+    ring.cq_mask = (unsigned*) (cq + p.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+    ring.cq_entries = p.cq_entries;
+    
+    // Completions wake the event loop through the same eventfd as the threads
+    if(syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_EVENTFD, &event_fd, 1) < 0) {
+        goto error;
+    }
+    
+    log_message(LOG_INFO, "Files are read through io_uring\r\n");
+    return true;
+    
+error:
+    log_message(LOG_WARNING, "Could not set up io_uring (%s), files are read on the I/O threads\r\n", strerror(errno));
+    _offload_ring_close();
+    return false;
+}
+
+/**
+ * Wait for the reads in flight and complete them. 
+ */
+static void _offload_ring_drain(void)
+{
+    int n;
+    
+    while(ring.fd >= 0 && ring.inflight > 0) {
+        n = syscall(__NR_io_uring_enter, ring.fd, ring.queued, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if(n < 0 && errno != EINTR) {
+            log_message(LOG_ERROR, "Could not wait for io_uring: %s\r\n", strerror(errno));
+            break;
+        }
+        if(n > 0) {
+            ring.queued -= n;
+        }
+        _offload_ring_reap(NULL);
+    }
+    loop_timer_stop(&ring.flush);
+}
+#endif
+
+/**
+ * Event loop handler for the completion eventfd. 
+ * @param context the websocket context. 
+ * @param fd the eventfd. 
+ * @param revents the poll events that occurred. 
+ * @param data unused. 
+ */
+static void _offload_ready(struct libwebsocket_context* context, int fd, short revents, void* data)
+{
+    uint64_t count;
+    
+    if(read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        log_message(LOG_ERROR, "Could not read the I/O completion counter: %s\r\n", strerror(errno));
+    }
+    _offload_complete(context);
+#ifdef HAVE_IO_URING
+    _offload_ring_reap(context);
+#endif
+}
+
+/**
+ * Start the I/O threads, must be called after the event loop exists and 
+ * after the process forked its workers. 
+ * @param count the number of threads, 0 runs the work on the event loop 
+ *        but still completes it on a later loop pass. 
+ * @param uring true to do reads through io_uring when the kernel allows it. 
+ * @return true on success. 
+ */
+bool offload_init(int count, bool uring)
+{
+    pthread_attr_t attr;
+    sigset_t all, old;
+    int i, err;
+    
+    if((event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        log_message(LOG_ERROR, "Could not create the I/O completion eventfd: %s\r\n", strerror(errno));
+        return false;
+    }
+    loop_add(event_fd, POLLIN, _offload_ready, NULL);
+    
+#ifdef HAVE_IO_URING
+    if(uring) {
+        _offload_ring_setup();
+    }
+#endif
+    
+    if(count <= 0) {
+        log_message(LOG_INFO, "Blocking I/O runs on the event loop\r\n");
+        return true;
+    }
+    
+    if((threads = calloc(count, sizeof(pthread_t))) == NULL) {
+        log_message(LOG_ERROR, "Could not allocate %d I/O threads, blocking I/O runs on the event loop\r\n", count);
+        return true;
+    }
+    
+    // Signals are for the event loop, the threads inherit a blocked mask
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, DPT_WEB_IDE_IO_STACK);
+    
+    for(i = 0; i < count; ++i) {
+        if((err = pthread_create(&threads[i], &attr, _offload_thread, NULL)) != 0) {
+            log_message(LOG_ERROR, "Could not start I/O thread: %s\r\n", strerror(err));
+            break;
+        }
+    }
+    thread_count = i;
+    
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    log_message(LOG_INFO, "Blocking I/O runs on %d thread%s\r\n", thread_count, thread_count == 1 ? "" : "s");
+    return true;
+}
+
+/**
+ * Finish the submitted jobs and stop the I/O threads. Jobs still waiting 
+ * are run and completed. 
+ */
+void offload_free(void)
+{
+    struct offload_job* job;
+    int i;
+    
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+    
+    for(i = 0; i < thread_count; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    threads = NULL;
+    thread_count = 0;
+    
+    // Without threads left the waiting jobs run here
+    while((job = waiting) != NULL) {
+        waiting = job->next;
+        _offload_run(job);
+    }
+    waiting_tail = &waiting;
+    waiting_count = 0;
+    
+#ifdef HAVE_IO_URING
+    _offload_ring_drain();
+    _offload_ring_close();
+#endif
+    
+    if(event_fd >= 0) {
+        _offload_complete(NULL);
+        loop_remove(event_fd);
+        close(event_fd);
+        event_fd = -1;
+    }
+    stopping = false;
+}
+
+/**
+ * Put a prepared job on the queue of the I/O threads. 
+ * @param job the job. 
+ */
+static void _offload_queue(struct offload_job* job)
+{
+    job->queued_us = _offload_now_us();
+    job->next = NULL;
+    
+    // Without threads the work is done now, it still completes on a later pass
+    if(thread_count == 0) {
+        _offload_run(job);
+        return;
+    }
+    
+    pthread_mutex_lock(&lock);
+    *waiting_tail = job;
+    waiting_tail = &job->next;
+    if(++waiting_count > stats.peak_waiting) {
+        stats.peak_waiting = waiting_count;
+    }
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Queue a job for the I/O threads. 
+ * @param job the job, must stay valid until it completes. 
+ * @param work the blocking work. 
+ * @param done the completion handler. 
+ * @param data data passed to both. 
+ */
+void offload_submit(struct offload_job* job, offload_work work, offload_done done, void* data)
+{
+    job->work = work;
+    job->done = done;
+    job->data = data;
+    _offload_queue(job);
+}
+
+/**
+ * Read from a file without blocking the event loop. Reads queued during a 
+ * loop pass go to io_uring in one submission at the end of the pass, or to 
+ * the I/O threads when there is no ring. 
+ * @param job the job, must stay valid until it completes, receives the result. 
+ * @param fd the file. 
+ * @param buf where the data goes. 
+ * @param len the number of bytes to read. 
+ * @param offset the offset in the file. 
+ * @param done the completion handler. 
+ * @param data handler data. 
+ */
+void offload_read(struct offload_job* job, int fd, void* buf, size_t len, off_t offset, offload_done done, void* data)
+{
+    job->work = NULL;
+    job->done = done;
+    job->data = data;
+    job->fd = fd;
+    job->iov.iov_base = buf;
+    job->iov.iov_len = len;
+    job->offset = offset;
+    
+#ifdef HAVE_IO_URING
+    job->queued_us = _offload_now_us();
+    if(_offload_ring_read(job)) {
+        return;
+    }
+#endif
+    _offload_queue(job);
+}
+
+/**
+ * Get the I/O thread counters. 
+ * @param st filled with the counters. 
+ */
+void offload_get_stats(struct offload_stats* st)
+{
+    *st = stats;
+}
@@ -0,0 +1,125 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   offload.h
+ * Created on October 17, 2026, 8:50 PM
+ */
+
+#ifndef OFFLOAD_H
+#define	OFFLOAD_H
+
+#include <libwebsockets.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/**
+ * Blocking part of a job, runs on an I/O thread. It must not touch 
+ * anything the event loop uses, including the logger and the buffer pool. 
+ */
+typedef void (*offload_work)(void* data);
+
+/**
+ * Completion of a job, runs on the event loop once the work is done. 
+ * The context is NULL when the job completes during offload_free(). 
+ */
+typedef void (*offload_done)(struct libwebsocket_context* context, void* data);
+
+/**
+ * A job for the I/O threads, owned by the caller until it completes. 
+ */
+struct offload_job {
+    offload_work work;                                  /* The blocking work, NULL for a read */
+    offload_done done;                                  /* Completion handler */
+    void* data;                                         /* Data passed to both */
+    int fd;                                             /* The file of a read */
+    struct iovec iov;                                   /* Where a read goes */
+    off_t offset;                                       /* Offset of a read in the file */
+    ssize_t result;                                     /* Bytes read or -errno */
+    long long queued_us;                                /* When the job was submitted */
+    long long work_us;                                  /* Time the work took */
+    struct offload_job* next;                           /* Next job in the same queue */
+};
+
+/**
+ * I/O thread counters. 
+ */
+struct offload_stats {
+    unsigned long jobs;                                 /* Jobs completed */
+    unsigned long long work_us;                         /* Time spent in blocking work */
+    long long max_work_us;                              /* Longest blocking work */
+    unsigned long long latency_us;                      /* Time from submitting to completion */
+    int peak_waiting;                                   /* Most jobs waiting for a thread */
+    unsigned long ring_jobs;                            /* Reads done through io_uring */
+    unsigned long submits;                              /* io_uring submissions for those reads */
+};
+
+/**
+ * Start the I/O threads, must be called after the event loop exists and 
+ * after the process forked its workers. 
+ * @param count the number of threads, 0 runs the work on the event loop 
+ *        but still completes it on a later loop pass. 
+ * @param uring true to do reads through io_uring when the kernel allows it. 
+ * @return true on success. 
+ */
+bool offload_init(int count, bool uring);
+
+/**
+ * Finish the submitted jobs and stop the I/O threads. Jobs still waiting 
+ * are run and completed. 
+ */
+void offload_free(void);
+
+/**
+ * Queue a job for the I/O threads. 
+ * @param job the job, must stay valid until it completes. 
+ * @param work the blocking work. 
+ * @param done the completion handler. 
+ * @param data data passed to both. 
+ */
+void offload_submit(struct offload_job* job, offload_work work, offload_done done, void* data);
+
+/**
+ * Read from a file without blocking the event loop. Reads queued during a 
+ * loop pass go to io_uring in one submission at the end of the pass, or to 
+ * the I/O threads when there is no ring. 
+ * @param job the job, must stay valid until it completes, receives the result. 
+ * @param fd the file. 
+ * @param buf where the data goes. 
+ * @param len the number of bytes to read. 
+ * @param offset the offset in the file. 
+ * @param done the completion handler. 
+ * @param data handler data. 
+ */
+void offload_read(struct offload_job* job, int fd, void* buf, size_t len, off_t offset, offload_done done, void* data);
+
+/**
+ * Get the I/O thread counters. 
+ * @param st filled with the counters. 
+ */
+void offload_get_stats(struct offload_stats* st);
+
+#endif
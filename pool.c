@@ -0,0 +1,162 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   pool.c
+ * Created on October 17, 2026, 10:12 AM
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "pool.h"
+#include "config.h"
+
+/* Number of power of two size classes */
+#define POOL_CLASSES (DPT_WEB_IDE_POOL_MAX_SHIFT - DPT_WEB_IDE_POOL_MIN_SHIFT + 1)
+
+/**
+ * A cached buffer, the link is stored inside the free buffer itself. 
+ */
+struct pool_buffer {
+    struct pool_buffer* next;
+};
+
+static struct pool_buffer* free_lists[POOL_CLASSES];   /* Free buffers per size class */
+static size_t max_cached_bytes = 0;                     /* Most bytes kept on the free lists */
+static struct pool_stats stats;                         /* Pool counters */
+
+/**
+ * Find the size class of a buffer. 
+ * @param size the buffer size. 
+ * @return the size class or -1 when the size is not pooled. 
+ */
+static int _pool_class(size_t size)
+{
+    int c = 0;
+    
+    while(c < POOL_CLASSES && ((size_t) 1 << (c + DPT_WEB_IDE_POOL_MIN_SHIFT)) < size) {
+        c++;
+    }
+    
+    return c < POOL_CLASSES ? c : -1;
+}
+
+/**
+ * Initialize the buffer pool. 
+ * @param max_cached the most bytes kept on the free lists. 
+ */
+void pool_init(size_t max_cached)
+{
+    max_cached_bytes = max_cached;
+}
+
+/**
+ * Free every cached buffer. Buffers still in use stay valid and are 
+ * freed when they are given back. 
+ */
+void pool_free_all(void)
+{
+    struct pool_buffer* buf;
+    int c;
+    
+    for(c = 0; c < POOL_CLASSES; ++c) {
+        while((buf = free_lists[c]) != NULL) {
+            free_lists[c] = buf->next;
+            free(buf);
+        }
+    }
+    stats.cached = 0;
+    max_cached_bytes = 0;
+}
+
+/**
+ * Get a buffer of at least the given size. Sizes are rounded up to a 
+ * power of two of at least 2^DPT_WEB_IDE_POOL_MIN_SHIFT, buffers larger 
+ * than 2^DPT_WEB_IDE_POOL_MAX_SHIFT are not pooled. 
+ * @param size the requested size. 
+ * @param actual filled with the usable size of the buffer, may be NULL. 
+ * @return the buffer or NULL when out of memory. 
+ */
+void* pool_alloc(size_t size, size_t* actual)
+{
+    struct pool_buffer* buf;
+    int c = _pool_class(size);
+    
+    if(c >= 0) {
+        size = (size_t) 1 << (c + DPT_WEB_IDE_POOL_MIN_SHIFT);
+        if((buf = free_lists[c]) != NULL) {
+            free_lists[c] = buf->next;
+            stats.cached -= size;
+            stats.reuses++;
+        } else if((buf = malloc(size)) == NULL) {
+            return NULL;
+        }
+    } else if((buf = malloc(size)) == NULL) {
+        return NULL;
+    }
+    
+    stats.allocs++;
+    stats.in_use += size;
+    if(actual != NULL) {
+        *actual = size;
+    }
+    return buf;
+}
+
+/**
+ * Give a buffer back to the pool. 
+ * @param buf the buffer, may be NULL. 
+ * @param size the usable size returned by pool_alloc(). 
+ */
+void pool_release(void* buf, size_t size)
+{
+    struct pool_buffer* b = buf;
+    int c;
+    
+    if(b == NULL) {
+        return;
+    }
+    
+    stats.in_use -= size;
+    c = _pool_class(size);
+    if(c < 0 || stats.cached + size > max_cached_bytes) {
+        free(b);
+        return;
+    }
+    
+    b->next = free_lists[c];
+    free_lists[c] = b;
+    stats.cached += size;
+}
+
+/**
+ * Get the buffer pool counters. 
+ * @param s the structure to fill. 
+ */
+void pool_get_stats(struct pool_stats* s)
+{
+    *s = stats;
+}
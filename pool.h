@@ -0,0 +1,82 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   pool.h
+ * Created on October 17, 2026, 10:12 AM
+ */
+
+#ifndef POOL_H
+#define	POOL_H
+
+#include <stddef.h>
+
+/**
+ * Buffer pool usage counters. 
+ */
+struct pool_stats {
+    unsigned long allocs;                               /* Buffers handed out */
+    unsigned long reuses;                               /* Buffers handed out from a free list */
+    size_t in_use;                                      /* Bytes handed out and not given back */
+    size_t cached;                                      /* Bytes kept on the free lists */
+};
+
+/**
+ * Initialize the buffer pool. 
+ * @param max_cached the most bytes kept on the free lists. 
+ */
+void pool_init(size_t max_cached);
+
+/**
+ * Free every cached buffer. Buffers still in use stay valid and are 
+ * freed when they are given back. 
+ */
+void pool_free_all(void);
+
+/**
+ * Get a buffer of at least the given size. Sizes are rounded up to a 
+ * power of two of at least 2^DPT_WEB_IDE_POOL_MIN_SHIFT, buffers larger 
+ * than 2^DPT_WEB_IDE_POOL_MAX_SHIFT are not pooled. 
+ * @param size the requested size. 
+ * @param actual filled with the usable size of the buffer, may be NULL. 
+ * @return the buffer or NULL when out of memory. 
+ */
+void* pool_alloc(size_t size, size_t* actual);
+
+/**
+ * Give a buffer back to the pool. 
+ * @param buf the buffer, may be NULL. 
+ * @param size the usable size returned by pool_alloc(). 
+ */
+void pool_release(void* buf, size_t size);
+
+/**
+ * Get the buffer pool counters. 
+ * @param s the structure to fill. 
+ */
+void pool_get_stats(struct pool_stats* s);
+
+#endif
+
@@ -28,77 +28,642 @@
  * Created on October 1, 2015, 12:06 PM
  */
 
+#define _GNU_SOURCE
+
 #include <unistd.h>
 #include <stdbool.h>
 #include <stdlib.h>
-#include <sched.h>
+#include <string.h>
+#include <spawn.h>
 #include <signal.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <pthread.h>
 
 #include "process.h"
+#include "loop.h"
 #include "logger.h"
 #include "config.h"
 
+extern char **environ;
+
+/**
+ * A child process known to the supervisor. 
+ */
+struct process_child {
+    pid_t pid;                                          /* The PID of the child */
+    int pidfd;                                          /* Readable once the child exited, -1 with a signalfd */
+    long long started;                                  /* Start of the wall time in ms, see loop_now() */
+    bool stopping;                                      /* SIGINT was sent, SIGKILL follows on the timer */
+    process_exit_handler handler;                       /* Called after the child was reaped */
+    void* data;                                         /* Handler data */
+    struct loop_timer kill_timer;                       /* Escalates a stop to SIGKILL */
+    struct process_child* next;                         /* Next supervised child */
+};
+
+static struct process_child* children = NULL;           /* Children that were not reaped yet */
+static bool use_pidfd = false;                          /* Watch children through a pidfd each */
+static int sig_fd = -1;                                 /* SIGCHLD signalfd when pidfds are not available */
+
+/* Steps a forked child reports a failure of, see _process_fork_exec() */
+#define PROCESS_STEP_SETUP      0
+#define PROCESS_STEP_CGROUP     1
+#define PROCESS_STEP_LIMIT      2
+#define PROCESS_STEP_EXEC       3
+
+/**
+ * Open a pidfd for a process. 
+ * @param pid the process. 
+ * @return the pidfd or -1 when pidfds are not supported. 
+ */
+static int _process_pidfd_open(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return syscall(SYS_pidfd_open, pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
 /**
- * Start a process and get a FILE to read the process
- * output. 
- * @param command the command to start. 
- * @param pid the PID of the spawned process.
- * @return the FILE handle to read from the process.
+ * Find a supervised child. 
+ * @param pid the process. 
+ * @return the child or NULL when it is not supervised. 
  */
-FILE* process_start(const char* command, pid_t* pid)
+static struct process_child* _process_find(pid_t pid)
 {
-    FILE *fp;
-    int pipe_fd[2];
-    int parent_fd;
-    int child_fd;
-    pid_t p;
+    struct process_child* c;
     
-    if(pipe(pipe_fd)) {
-        log_message(LOG_ERROR, "Could not create child process pipe\r\n");
-        return NULL;
+    for(c = children; c != NULL && c->pid != pid; c = c->next);
+    return c;
+}
+
+/**
+ * Stop supervising a child and free it. 
+ * @param child the child. 
+ */
+static void _process_forget(struct process_child* child)
+{
+    struct process_child** c;
+    
+    for(c = &children; *c != child; c = &(*c)->next);
+    *c = child->next;
+    
+    loop_timer_stop(&child->kill_timer);
+    if(child->pidfd >= 0) {
+        loop_remove(child->pidfd);
+        close(child->pidfd);
+    }
+    free(child);
+}
+
+/**
+ * Reap a child when it has exited and report its status. 
+ * @param context the websocket context. 
+ * @param child the child. 
+ * @return true when the child was reaped. 
+ */
+static bool _process_reap(struct libwebsocket_context* context, struct process_child* child)
+{
+    struct process_status st;
+    struct rusage ru;
+    process_exit_handler handler;
+    void* data;
+    int status;
+    
+    if(wait4(child->pid, &status, WNOHANG, &ru) != child->pid) {
+        return false;
+    }
+    
+    st.code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    st.signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+    st.wall_ms = loop_now() - child->started;
+    st.user_us = ru.ru_utime.tv_sec * 1000000LL + ru.ru_utime.tv_usec;
+    st.sys_us = ru.ru_stime.tv_sec * 1000000LL + ru.ru_stime.tv_usec;
+    st.max_rss_kb = ru.ru_maxrss;
+    log_message(LOG_DEBUG, "Process %d ended: code %d, signal %d\r\n", (int) child->pid, st.code, st.signal);
+    
+    /* Whatever the stopped program left behind in its group goes too */
+    if(child->stopping) {
+        kill(-child->pid, SIGKILL);
+    }
+    
+    handler = child->handler;
+    data = child->data;
+    _process_forget(child);
+    
+    if(handler != NULL) {
+        handler(context, &st, data);
+    }
+    return true;
+}
+
+/**
+ * Event loop handler for a pidfd that became readable. 
+ * @param context the websocket context. 
+ * @param fd the pidfd. 
+ * @param revents the poll events that occurred. 
+ * @param data the child. 
+ */
+static void _process_exited(struct libwebsocket_context* context, int fd, short revents, void* data)
+{
+    _process_reap(context, (struct process_child*) data);
+}
+
+/**
+ * Event loop handler for SIGCHLD, reaps every child that exited. 
+ * @param context the websocket context. 
+ * @param fd the signalfd. 
+ * @param revents the poll events that occurred. 
+ * @param data unused. 
+ */
+static void _process_sigchld(struct libwebsocket_context* context, int fd, short revents, void* data)
+{
+    struct signalfd_siginfo info;
+    struct process_child* c;
+    struct process_child* next;
+    
+    /* Signals coalesce, so each one only means at least one child exited */
+    while(read(fd, &info, sizeof(info)) == sizeof(info));
+    
+    for(c = children; c != NULL; c = next) {
+        next = c->next;
+        _process_reap(context, c);
+    }
+}
+
+/**
+ * Timer handler killing a process group that ignored SIGINT. 
+ * @param context the websocket context. 
+ * @param data the child. 
+ */
+static void _process_escalate(struct libwebsocket_context* context, void* data)
+{
+    struct process_child* child = (struct process_child*) data;
+    
+    log_message(LOG_WARNING, "Process %d did not stop within %d ms, killing it\r\n", (int) child->pid, conf->kill_timeout);
+    kill(-child->pid, SIGKILL);
+}
+
+/**
+ * Start supervising child processes from the event loop, through a pidfd 
+ * per child or a signalfd for SIGCHLD on kernels without pidfds. 
+ * @return true on success. 
+ */
+bool process_init(void)
+{
+    sigset_t mask;
+    int fd;
+    
+    if((fd = _process_pidfd_open(getpid())) >= 0) {
+        close(fd);
+        use_pidfd = true;
+        log_message(LOG_DEBUG, "Supervising child processes with pidfds\r\n");
+        return true;
+    }
+    
+    /* SIGCHLD is only delivered through the signalfd */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    
+    if((sig_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0) {
+        log_message(LOG_ERROR, "Could not create SIGCHLD signalfd: %s\r\n", strerror(errno));
+        return false;
+    }
+    
+    loop_add(sig_fd, POLLIN, _process_sigchld, NULL);
+    log_message(LOG_DEBUG, "Supervising child processes with a signalfd\r\n");
+    return true;
+}
+
+/**
+ * Kill and reap all child processes that are still running. 
+ */
+void process_free(void)
+{
+    while(children != NULL) {
+        kill(-children->pid, SIGKILL);
+        waitpid(children->pid, NULL, 0);
+        _process_forget(children);
+    }
+    
+    if(sig_fd >= 0) {
+        loop_remove(sig_fd);
+        close(sig_fd);
+        sig_fd = -1;
+    }
+}
+
+/**
+ * Start a process with posix_spawn(). 
+ * @param opts how to start the process. 
+ * @param dups copies of the extra descriptors that map onto themselves, -1 otherwise. 
+ * @param out the write end of the stdout pipe. 
+ * @param err the write end of the stderr pipe. 
+ * @param pid filled with the PID of the process. 
+ * @return 0 on success or an error number. 
+ */
+static int _process_posix_spawn(const struct process_options* opts, const int* dups, int out, int err, pid_t* pid)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t sigs;
+    int i, rc;
+    
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, out, 1);
+    posix_spawn_file_actions_adddup2(&actions, err, 2);
+    for(i = 0; i < opts->fd_count; ++i) {
+        posix_spawn_file_actions_adddup2(&actions, dups[i] >= 0 ? dups[i] : opts->fds[i].fd, opts->fds[i].target);
+    }
+    
+    if(opts->cwd != NULL) {
+#ifdef HAVE_SPAWN_CHDIR
+        posix_spawn_file_actions_addchdir_np(&actions, opts->cwd);
+#else
+        log_message(LOG_WARNING, "Can't set the working directory of child processes on this system\r\n");
+#endif
     }
     
-    child_fd = pipe_fd[1];
-    parent_fd = pipe_fd[0];
+    /* The server ignores SIGPIPE and may block SIGCHLD, the child gets the defaults back */
+    posix_spawnattr_init(&attr);
+    sigemptyset(&sigs);
+    posix_spawnattr_setsigmask(&attr, &sigs);
+    sigaddset(&sigs, SIGPIPE);
+    sigaddset(&sigs, SIGCHLD);
+    posix_spawnattr_setsigdefault(&attr, &sigs);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+    
+    rc = posix_spawnp(pid, opts->argv[0], &actions, &attr, (char* const*) opts->argv, 
+            (char* const*) (opts->envp != NULL ? opts->envp : (const char* const*) environ));
+    
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return rc;
+}
+
+/**
+ * Check whether any limit is set. 
+ * @param limits the limits, may be NULL. 
+ * @return true when something is limited. 
+ */
+static bool _process_limited(const struct process_limits* limits)
+{
+    return limits != NULL && (limits->cpu_seconds > 0 || limits->memory_kb > 0 || limits->files > 0 || 
+            (limits->cgroup != NULL && limits->cgroup[0] != '\0'));
+}
+
+/**
+ * Start a process with fork() so its resource limits and cgroup are set 
+ * before it executes anything. The child does what posix_spawn() would 
+ * do and only makes async-signal-safe calls, the server may have threads. 
+ * @param opts how to start the process, with limits. 
+ * @param dups copies of the extra descriptors that map onto themselves, -1 otherwise. 
+ * @param out the write end of the stdout pipe. 
+ * @param err the write end of the stderr pipe. 
+ * @param pid filled with the PID of the process. 
+ * @return 0 on success or an error number. 
+ */
+static int _process_fork_exec(const struct process_options* opts, const int* dups, int out, int err, pid_t* pid)
+{
+    const struct process_limits* limits = opts->limits;
+    char* const* envp = (char* const*) (opts->envp != NULL ? opts->envp : (const char* const*) environ);
+    char path[DPT_WEB_IDE_HTTP_PATH_BUFF];
+    struct rlimit rl[3];
+    int resources[3];
+    int count = 0;
+    struct sigaction sa, cur;
+    sigset_t all, old;
+    int report[2];
+    int sync_fd[2];
+    ssize_t n;
+    int i, fd;
+    
+    /* Everything that allocates or formats happens before the fork */
+    if(limits->cpu_seconds > 0) {
+        resources[count] = RLIMIT_CPU;
+        rl[count].rlim_cur = limits->cpu_seconds;
+        rl[count++].rlim_max = limits->cpu_seconds + 1;
+    }
+    if(limits->memory_kb > 0) {
+        resources[count] = RLIMIT_AS;
+        rl[count].rlim_cur = (rlim_t) limits->memory_kb * 1024;
+        rl[count++].rlim_max = (rlim_t) limits->memory_kb * 1024;
+    }
+    if(limits->files > 0) {
+        resources[count] = RLIMIT_NOFILE;
+        rl[count].rlim_cur = limits->files;
+        rl[count++].rlim_max = limits->files;
+    }
+    path[0] = '\0';
+    if(limits->cgroup != NULL && limits->cgroup[0] != '\0') {
+        snprintf(path, sizeof(path), "%s/cgroup.procs", limits->cgroup);
+    }
     
-    if(!(fp = fdopen(parent_fd, "r"))) {
-        close(parent_fd);
-        close(child_fd);
-        return NULL;
+    /* The child reports the step that failed and why, exec closes the pipe on success */
+    if(pipe2(sync_fd, O_CLOEXEC)) {
+        return errno;
     }
     
-    if((p = vfork()) == 0) {
-        close(parent_fd);
-        if(child_fd != 1) {
-            dup2(child_fd, 1);
-            close(child_fd);
+    /* No server signal handler may run in the child before exec */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    
+    if((*pid = fork()) == 0) {
+        close(sync_fd[0]);
+        setpgid(0, 0);
+        
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = SIG_DFL;
+        for(i = 1; i < NSIG; ++i) {
+            if(sigaction(i, NULL, &cur) == 0 && (i == SIGPIPE || i == SIGCHLD || cur.sa_handler != SIG_IGN)) {
+                sigaction(i, &sa, NULL);
+            }
         }
         
-        execl("/bin/sh", "sh", "-c", command, (char *)0);
+        report[0] = PROCESS_STEP_SETUP;
+        if(dup2(out, 1) < 0 || dup2(err, 2) < 0) {
+            goto fail;
+        }
+        for(i = 0; i < opts->fd_count; ++i) {
+            if(dup2(dups[i] >= 0 ? dups[i] : opts->fds[i].fd, opts->fds[i].target) < 0) {
+                goto fail;
+            }
+        }
+        if(opts->cwd != NULL && chdir(opts->cwd) < 0) {
+            goto fail;
+        }
+        
+        /* Writing 0 moves the writer, everything it starts is created inside the cgroup */
+        report[0] = PROCESS_STEP_CGROUP;
+        if(path[0] != '\0') {
+            fd = open(path, O_WRONLY | O_CLOEXEC);
+            if(fd < 0 || write(fd, "0\n", 2) != 2) {
+                goto fail;
+            }
+            close(fd);
+        }
+        
+        /* Last, a low file limit would stop the dup2() calls */
+        report[0] = PROCESS_STEP_LIMIT;
+        for(i = 0; i < count; ++i) {
+            if(setrlimit(resources[i], &rl[i]) < 0) {
+                goto fail;
+            }
+        }
+        
+        report[0] = PROCESS_STEP_EXEC;
+        sigemptyset(&all);
+        sigprocmask(SIG_SETMASK, &all, NULL);
+        execvpe(opts->argv[0], (char* const*) opts->argv, envp);
+        
+fail:
+        report[1] = errno;
+        if(write(sync_fd[1], report, sizeof(report)) != sizeof(report)) {
+            _exit(126);
+        }
         _exit(127);
     }
+    
+    report[1] = errno;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    close(sync_fd[1]);
+    if(*pid < 0) {
+        close(sync_fd[0]);
+        return report[1];
+    }
+    
+    while((n = read(sync_fd[0], report, sizeof(report))) < 0 && errno == EINTR);
+    close(sync_fd[0]);
+    if(n != sizeof(report)) {
+        return 0;
+    }
+    
+    if(report[0] == PROCESS_STEP_CGROUP) {
+        log_message(LOG_ERROR, "Could not move %s to cgroup %s: %s\r\n", opts->argv[0], limits->cgroup, strerror(report[1]));
+    } else if(report[0] == PROCESS_STEP_LIMIT) {
+        log_message(LOG_ERROR, "Could not limit the resources of %s: %s\r\n", opts->argv[0], strerror(report[1]));
+    }
+    while(waitpid(*pid, NULL, 0) < 0 && errno == EINTR);
+    *pid = -1;
+    return report[1];
+}
+
+/**
+ * Start a process in its own process group with its stdout and stderr 
+ * connected to separate pipes. No shell is involved. Limits are in place 
+ * before the program executes. 
+ * @param opts how to start the process. 
+ * @param p filled with the process. 
+ * @return true on success. 
+ */
+bool process_spawn(const struct process_options* opts, struct process* p)
+{
+    struct process_child* child;
+    int out_fd[2];
+    int err_fd[2];
+    int dups[opts->fd_count > 0 ? opts->fd_count : 1];
+    int i, rc;
+    
+    p->pid = -1;
+    p->out = -1;
+    p->err = -1;
+    
+    if((child = calloc(1, sizeof(struct process_child))) == NULL) {
+        log_message(LOG_ERROR, "Could not allocate child process\r\n");
+        return false;
+    }
+    
+    /* Only the dup2() copies in the child lose the close-on-exec flag */
+    if(pipe2(out_fd, O_CLOEXEC)) {
+        log_message(LOG_ERROR, "Could not create child process pipe\r\n");
+        free(child);
+        return false;
+    }
+    if(pipe2(err_fd, O_CLOEXEC)) {
+        log_message(LOG_ERROR, "Could not create child process pipe\r\n");
+        close(out_fd[0]);
+        close(out_fd[1]);
+        free(child);
+        return false;
+    }
+    
+    /* dup2() onto itself would keep the close-on-exec flag, go through a copy */
+    for(i = 0; i < opts->fd_count; ++i) {
+        dups[i] = -1;
+        if(opts->fds[i].fd == opts->fds[i].target) {
+            dups[i] = fcntl(opts->fds[i].fd, F_DUPFD_CLOEXEC, 3);
+        }
+    }
+    
+    /* posix_spawn() can't limit a child before it executes the program */
+    if(_process_limited(opts->limits)) {
+        rc = _process_fork_exec(opts, dups, out_fd[1], err_fd[1], &p->pid);
+    } else {
+        rc = _process_posix_spawn(opts, dups, out_fd[1], err_fd[1], &p->pid);
+    }
+    
+    for(i = 0; i < opts->fd_count; ++i) {
+        if(dups[i] >= 0) {
+            close(dups[i]);
+        }
+    }
+    close(out_fd[1]);
+    close(err_fd[1]);
+    
+    if(rc != 0) {
+        log_message(LOG_ERROR, "Could not start %s: %s\r\n", opts->argv[0], strerror(rc));
+        close(out_fd[0]);
+        close(err_fd[0]);
+        free(child);
+        p->pid = -1;
+        return false;
+    }
+    
+    p->out = out_fd[0];
+    p->err = err_fd[0];
+    fcntl(p->out, F_SETFL, O_NONBLOCK);
+    fcntl(p->err, F_SETFL, O_NONBLOCK);
+    
+    /* A child nothing watches would never be reaped, don't let it run */
+    child->pidfd = -1;
+    if(use_pidfd && (child->pidfd = _process_pidfd_open(p->pid)) < 0) {
+        log_message(LOG_ERROR, "Could not open pidfd for process %d: %s\r\n", (int) p->pid, strerror(errno));
+        kill(-p->pid, SIGKILL);
+        waitpid(p->pid, NULL, 0);
+        close(p->out);
+        close(p->err);
+        free(child);
+        p->pid = p->out = p->err = -1;
+        return false;
+    }
+    
+    /* The supervisor reaps the child, with or without an exit handler */
+    child->pid = p->pid;
+    child->started = loop_now();
+    child->next = children;
+    children = child;
+    if(child->pidfd >= 0) {
+        loop_add(child->pidfd, POLLIN, _process_exited, child);
+    }
+    
+    log_message(LOG_DEBUG, "Process succesfully started\r\n");
+    return true;
+}
+
+/**
+ * Close the pipes of a process and ask its process group to stop with 
+ * SIGINT. The group gets SIGKILL when it is still running after the 
+ * configured kill timeout. The process is reaped by the supervisor, the 
+ * PID stays set so the exit handler can still be changed. 
+ * @param p the process. 
+ */
+void process_stop(struct process* p)
+{
+    struct process_child* child;
+    
+    if(p->out >= 0) {
+        close(p->out);
+        p->out = -1;
+    }
+    if(p->err >= 0) {
+        close(p->err);
+        p->err = -1;
+    }
+    
+    if(p->pid <= 0 || (child = _process_find(p->pid)) == NULL || child->stopping) {
+        return;
+    }
+    
+    child->stopping = true;
+    kill(-p->pid, SIGINT);
+    loop_timer_start(&child->kill_timer, conf->kill_timeout, _process_escalate, child);
+}
 
-    close(child_fd);
+/**
+ * Set one resource limit of another process. 
+ * @param pid the process. 
+ * @param resource the resource. 
+ * @param soft the soft limit. 
+ * @param hard the hard limit. 
+ * @return true on success. 
+ */
+static bool _process_rlimit(pid_t pid, int resource, rlim_t soft, rlim_t hard)
+{
+    struct rlimit rl;
+    
+    rl.rlim_cur = soft;
+    rl.rlim_max = hard;
+    if(prlimit(pid, resource, &rl, NULL)) {
+        log_message(LOG_ERROR, "Could not set resource limit %d of process %d: %s\r\n", resource, (int) pid, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Limit the resources of a started process. The limits are inherited by 
+ * everything it starts afterwards, what ran before wasn't limited. Use 
+ * process_options.limits when starting a process instead. 
+ * @param pid the process. 
+ * @param limits the limits to apply. 
+ * @return true on success. 
+ */
+bool process_limit(pid_t pid, const struct process_limits* limits)
+{
+    char path[DPT_WEB_IDE_HTTP_PATH_BUFF];
+    bool ok = true;
+    int fd;
+    
+    if(limits->cpu_seconds > 0) {
+        ok &= _process_rlimit(pid, RLIMIT_CPU, limits->cpu_seconds, limits->cpu_seconds + 1);
+    }
+    if(limits->memory_kb > 0) {
+        ok &= _process_rlimit(pid, RLIMIT_AS, (rlim_t) limits->memory_kb * 1024, (rlim_t) limits->memory_kb * 1024);
+    }
+    if(limits->files > 0) {
+        ok &= _process_rlimit(pid, RLIMIT_NOFILE, limits->files, limits->files);
+    }
     
-    if(p > 0) {
-        log_message(LOG_DEBUG, "Process succesfully started\r\n");
-        *pid = p;
-        return fp;
+    if(limits->cgroup == NULL || limits->cgroup[0] == '\0') {
+        return ok;
     }
     
-    fclose(fp);
-    return NULL;
+    /* Processes the program forks later are created inside the cgroup */
+    snprintf(path, sizeof(path), "%s/cgroup.procs", limits->cgroup);
+    if((fd = open(path, O_WRONLY | O_CLOEXEC)) < 0 || dprintf(fd, "%d\n", (int) pid) < 0) {
+        log_message(LOG_ERROR, "Could not move process %d to cgroup %s: %s\r\n", (int) pid, limits->cgroup, strerror(errno));
+        ok = false;
+    }
+    if(fd >= 0) {
+        close(fd);
+    }
+    return ok;
 }
 
 /**
- * Stop a child process and close it's stdin and stdout. 
- * @param p the child process to stop.
+ * Set the handler called when a process exits and restart its wall time. 
+ * @param pid the process. 
+ * @param handler the handler, NULL to ignore the exit. 
+ * @param data handler data. 
  */
-void process_stop(FILE* stream, pid_t pid)
+void process_on_exit(pid_t pid, process_exit_handler handler, void* data)
 {
-    fclose(stream);
-    kill(pid, SIGINT);
-    kill(pid, SIGKILL);
-}
\ No newline at end of file
+    struct process_child* child;
+    
+    if((child = _process_find(pid)) != NULL) {
+        child->handler = handler;
+        child->data = data;
+        if(handler != NULL) {
+            child->started = loop_now();
+        }
+    }
+}
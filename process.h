@@ -31,23 +31,113 @@
 #ifndef PROCESS_H
 #define	PROCESS_H
 
+#include <libwebsockets.h>
 #include <stdbool.h>
-#include <stdio.h>
-#include <fcntl.h>
+#include <sys/types.h>
 
 /**
- * Start a process and get a FILE to read the process
- * output. 
- * @param command the command to start. 
- * @param pid the PID of the spawned process.
- * @return the FILE handle to read from the process.
+ * A file descriptor to install in a child process. 
  */
-FILE* process_start(const char* command, pid_t* pid);
+struct process_fd_map {
+    int fd;                                             /* Descriptor in the parent */
+    int target;                                         /* Descriptor number in the child */
+};
 
 /**
- * Stop a child process and close it's stdin and stdout. 
- * @param p the child process to stop.
+ * Resource limits for a process, zero or empty fields are not limited. 
  */
-void process_stop(FILE* stream, pid_t pid);
-#endif
+struct process_limits {
+    int cpu_seconds;                                    /* CPU time before SIGXCPU, SIGKILL a second later */
+    long memory_kb;                                     /* Address space */
+    int files;                                          /* Open file descriptors */
+    const char* cgroup;                                 /* cgroup v2 directory to move the process to */
+};
+
+/**
+ * How to start a process. 
+ */
+struct process_options {
+    const char* const* argv;                            /* Arguments, argv[0] is the program, NULL terminated */
+    const char* cwd;                                    /* Working directory, NULL to keep the current one */
+    const char* const* envp;                            /* Environment, NULL to inherit it */
+    const struct process_fd_map* fds;                   /* Extra descriptors, for example stdin */
+    int fd_count;                                       /* Number of extra descriptors */
+    const struct process_limits* limits;                /* Applied before the program runs, NULL for none */
+};
+
+/**
+ * A started process. 
+ */
+struct process {
+    pid_t pid;                                          /* The PID of the process, -1 when not running */
+    int out;                                            /* Read end of the stdout pipe, non blocking */
+    int err;                                            /* Read end of the stderr pipe, non blocking */
+};
+
+/**
+ * How a supervised process ended and what it used. 
+ */
+struct process_status {
+    int code;                                           /* Exit code, -1 when a signal ended the process */
+    int signal;                                         /* Signal that ended the process, 0 when it exited */
+    long long wall_ms;                                  /* Time from process_on_exit() to the exit */
+    long long user_us;                                  /* CPU time spent in user mode */
+    long long sys_us;                                   /* CPU time spent in the kernel */
+    long max_rss_kb;                                    /* Peak resident memory */
+};
+
+/**
+ * Called once a supervised process has exited and was reaped. 
+ */
+typedef void (*process_exit_handler)(struct libwebsocket_context* context, const struct process_status* status, void* data);
+
+/**
+ * Start supervising child processes from the event loop, through a pidfd 
+ * per child or a signalfd for SIGCHLD on kernels without pidfds. 
+ * @return true on success. 
+ */
+bool process_init(void);
 
+/**
+ * Kill and reap all child processes that are still running. 
+ */
+void process_free(void);
+
+/**
+ * Start a process in its own process group with its stdout and stderr 
+ * connected to separate pipes. No shell is involved. Limits are in place 
+ * before the program executes. 
+ * @param opts how to start the process. 
+ * @param p filled with the process. 
+ * @return true on success. 
+ */
+bool process_spawn(const struct process_options* opts, struct process* p);
+
+/**
+ * Close the pipes of a process and ask its process group to stop with 
+ * SIGINT. The group gets SIGKILL when it is still running after the 
+ * configured kill timeout. The process is reaped by the supervisor, the 
+ * PID stays set so the exit handler can still be changed. 
+ * @param p the process. 
+ */
+void process_stop(struct process* p);
+
+/**
+ * Limit the resources of a started process. The limits are inherited by 
+ * everything it starts afterwards, what ran before wasn't limited. Use 
+ * process_options.limits when starting a process instead. 
+ * @param pid the process. 
+ * @param limits the limits to apply. 
+ * @return true on success. 
+ */
+bool process_limit(pid_t pid, const struct process_limits* limits);
+
+/**
+ * Set the handler called when a process exits and restart its wall time. 
+ * @param pid the process. 
+ * @param handler the handler, NULL to ignore the exit. 
+ * @param data handler data. 
+ */
+void process_on_exit(pid_t pid, process_exit_handler handler, void* data);
+
+#endif
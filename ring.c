@@ -0,0 +1,217 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   ring.c
+ * Created on October 17, 2026, 10:12 AM
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+#include "ring.h"
+#include "pool.h"
+
+/**
+ * Allocate the buffer of a ring. 
+ * @param r the ring. 
+ * @param size the capacity in bytes. 
+ * @return true on success. 
+ */
+bool ring_init(struct ring* r, size_t size)
+{
+    if((r->data = pool_alloc(size, &r->alloc)) == NULL) {
+        return false;
+    }
+    
+    r->size = size;
+    r->head = 0;
+    r->used = 0;
+    return true;
+}
+
+/**
+ * Give the buffer of a ring back to the pool, the ring can be 
+ * initialized again afterwards. 
+ * @param r the ring. 
+ */
+void ring_free(struct ring* r)
+{
+    pool_release(r->data, r->alloc);
+    r->data = NULL;
+    r->alloc = 0;
+    r->size = 0;
+    r->head = 0;
+    r->used = 0;
+}
+
+/**
+ * Get the free space of a ring. 
+ * @param r the ring. 
+ * @return the number of bytes that can be added. 
+ */
+size_t ring_space(const struct ring* r)
+{
+    return r->size - r->used;
+}
+
+/**
+ * Split the free space of a ring in at most two contiguous parts. 
+ * @param r the ring. 
+ * @param iov filled with the free parts. 
+ * @return the number of parts. 
+ */
+static int _ring_free_parts(const struct ring* r, struct iovec* iov)
+{
+    size_t tail = (r->head + r->used) % r->size;
+    size_t space = ring_space(r);
+    
+    if(space == 0) {
+        return 0;
+    }
+    
+    iov[0].iov_base = r->data + tail;
+    iov[0].iov_len = tail + space <= r->size ? space : r->size - tail;
+    if(iov[0].iov_len == space) {
+        return 1;
+    }
+    
+    iov[1].iov_base = r->data;
+    iov[1].iov_len = space - iov[0].iov_len;
+    return 2;
+}
+
+/**
+ * Add data to a ring. 
+ * @param r the ring. 
+ * @param data the data to add. 
+ * @param len the length of the data. 
+ * @return the number of bytes added, less than len when the ring is full. 
+ */
+size_t ring_write(struct ring* r, const void* data, size_t len)
+{
+    const unsigned char* p = data;
+    struct iovec iov[2];
+    size_t done = 0, n;
+    int i, parts = _ring_free_parts(r, iov);
+    
+    for(i = 0; i < parts && done < len; ++i) {
+        n = len - done < iov[i].iov_len ? len - done : iov[i].iov_len;
+        memcpy(iov[i].iov_base, p + done, n);
+        done += n;
+    }
+    
+    r->used += done;
+    return done;
+}
+
+/**
+ * Read from a file descriptor into the free space of a ring. 
+ * @param r the ring. 
+ * @param fd the file descriptor. 
+ * @return the bytes read, 0 on end of file or -1 on error (EAGAIN 
+ * when nothing was available). 
+ */
+ssize_t ring_read_fd(struct ring* r, int fd)
+{
+    struct iovec iov[2];
+    int parts = _ring_free_parts(r, iov);
+    ssize_t n;
+    
+    if(parts == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    
+    do {
+        n = readv(fd, iov, parts);
+    } while(n < 0 && errno == EINTR);
+    
+    if(n > 0) {
+        r->used += n;
+    }
+    return n;
+}
+
+/**
+ * Copy the oldest data out of a ring without removing it. 
+ * @param r the ring. 
+ * @param buf the buffer to copy to. 
+ * @param len the size of the buffer. 
+ * @return the number of bytes copied. 
+ */
+size_t ring_peek(const struct ring* r, void* buf, size_t len)
+{
+    return ring_peek_at(r, 0, buf, len);
+}
+
+/**
+ * Copy data out of a ring without removing it, starting past the oldest 
+ * bytes. 
+ * @param r the ring. 
+ * @param offset the number of oldest bytes to skip. 
+ * @param buf the buffer to copy to. 
+ * @param len the size of the buffer. 
+ * @return the number of bytes copied. 
+ */
+size_t ring_peek_at(const struct ring* r, size_t offset, void* buf, size_t len)
+{
+    size_t start, first;
+    
+    if(offset >= r->used) {
+        return 0;
+    }
+    if(len > r->used - offset) {
+        len = r->used - offset;
+    }
+    
+    start = (r->head + offset) % r->size;
+    first = start + len <= r->size ? len : r->size - start;
+    memcpy(buf, r->data + start, first);
+    memcpy((unsigned char*) buf + first, r->data, len - first);
+    return len;
+}
+
+/**
+ * Remove the oldest data from a ring. 
+ * @param r the ring. 
+ * @param len the number of bytes to remove. 
+ */
+void ring_consume(struct ring* r, size_t len)
+{
+    if(len > r->used) {
+        len = r->used;
+    }
+    
+    r->head = (r->head + len) % r->size;
+    r->used -= len;
+    if(r->used == 0) {
+        r->head = 0;
+    }
+}
@@ -0,0 +1,117 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   ring.h
+ * Created on October 17, 2026, 10:12 AM
+ */
+
+#ifndef RING_H
+#define	RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * A bounded byte ring buffer. 
+ */
+struct ring {
+    unsigned char* data;                                /* The buffer, from the buffer pool */
+    size_t alloc;                                       /* Allocated size of the buffer */
+    size_t size;                                        /* Capacity of the ring */
+    size_t head;                                        /* Offset of the oldest byte */
+    size_t used;                                        /* Bytes in the ring */
+};
+
+/**
+ * Allocate the buffer of a ring. 
+ * @param r the ring. 
+ * @param size the capacity in bytes. 
+ * @return true on success. 
+ */
+bool ring_init(struct ring* r, size_t size);
+
+/**
+ * Give the buffer of a ring back to the pool, the ring can be 
+ * initialized again afterwards. 
+ * @param r the ring. 
+ */
+void ring_free(struct ring* r);
+
+/**
+ * Get the free space of a ring. 
+ * @param r the ring. 
+ * @return the number of bytes that can be added. 
+ */
+size_t ring_space(const struct ring* r);
+
+/**
+ * Add data to a ring. 
+ * @param r the ring. 
+ * @param data the data to add. 
+ * @param len the length of the data. 
+ * @return the number of bytes added, less than len when the ring is full. 
+ */
+size_t ring_write(struct ring* r, const void* data, size_t len);
+
+/**
+ * Read from a file descriptor into the free space of a ring. 
+ * @param r the ring. 
+ * @param fd the file descriptor. 
+ * @return the bytes read, 0 on end of file or -1 on error (EAGAIN 
+ * when nothing was available). 
+ */
+ssize_t ring_read_fd(struct ring* r, int fd);
+
+/**
+ * Copy the oldest data out of a ring without removing it. 
+ * @param r the ring. 
+ * @param buf the buffer to copy to. 
+ * @param len the size of the buffer. 
+ * @return the number of bytes copied. 
+ */
+size_t ring_peek(const struct ring* r, void* buf, size_t len);
+
+/**
+ * Copy data out of a ring without removing it, starting past the oldest 
+ * bytes. 
+ * @param r the ring. 
+ * @param offset the number of oldest bytes to skip. 
+ * @param buf the buffer to copy to. 
+ * @param len the size of the buffer. 
+ * @return the number of bytes copied. 
+ */
+size_t ring_peek_at(const struct ring* r, size_t offset, void* buf, size_t len);
+
+/**
+ * Remove the oldest data from a ring. 
+ * @param r the ring. 
+ * @param len the number of bytes to remove. 
+ */
+void ring_consume(struct ring* r, size_t len);
+
+#endif
+
@@ -0,0 +1,258 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   runq.c
+ * Created on October 17, 2026, 7:15 PM
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <poll.h>
+
+#include "runq.h"
+#include "loop.h"
+#include "worker.h"
+#include "logger.h"
+
+static int max_running = 0;                             /* Interpreters allowed at once, 0 for no limit */
+static int running = 0;                                 /* Slots in use by this process */
+static int slot_fd = -1;                                /* Slots shared with the other workers, see worker_slot_fd() */
+static int waiting = 0;                                 /* Runs in the queue */
+static struct runq_entry* head = NULL;                 /* Oldest waiting run */
+static struct runq_entry* tail = NULL;                 /* Newest waiting run */
+static struct runq_stats stats;                        /* Scheduler counters */
+
+/**
+ * Tell the waiting runs from a given position on where they are now. 
+ * @param context the websocket context. 
+ * @param e the first run to tell. 
+ * @param position the position of that run. 
+ */
+static void _runq_notify(struct libwebsocket_context* context, struct runq_entry* e, int position)
+{
+    for(; e != NULL; e = e->next) {
+        e->handler(context, e->data, position++);
+    }
+}
+
+/**
+ * Try to take a slot. 
+ * @return true when a slot was taken. 
+ */
+static bool _runq_take(void)
+{
+    if(max_running <= 0) {
+        return true;
+    }
+    if(slot_fd >= 0) {
+        return worker_slot_take();
+    }
+    return running < max_running;
+}
+
+/**
+ * Only wait for slots freed by other workers while runs are waiting. 
+ */
+static void _runq_watch(void)
+{
+    if(slot_fd >= 0) {
+        loop_modify(slot_fd, head != NULL ? POLLIN : 0);
+    }
+}
+
+/**
+ * Start waiting runs for as long as slots are free. 
+ * @param context the websocket context. 
+ */
+static void _runq_next(struct libwebsocket_context* context)
+{
+    struct runq_entry* e;
+    bool started = false;
+    
+    while((e = head) != NULL && _runq_take()) {
+        if((head = e->next) == NULL) {
+            tail = NULL;
+        }
+        e->queued = false;
+        waiting--;
+        running++;
+        stats.admitted++;
+        stats.wait_ms += loop_now() - e->since;
+        started = true;
+        
+        e->handler(context, e->data, 0);
+    }
+    
+    if(started) {
+        _runq_notify(context, head, 1);
+    }
+    _runq_watch();
+}
+
+/**
+ * Event loop handler for the shared slot pipe. 
+ * @param context the websocket context. 
+ * @param fd the read end of the slot pipe. 
+ * @param revents the poll events that occurred. 
+ * @param data unused. 
+ */
+static void _runq_slot_ready(struct libwebsocket_context* context, int fd, short revents, void* data)
+{
+    _runq_next(context);
+}
+
+/**
+ * Start the run scheduler. When workers share the slots the limit holds 
+ * for all of them together and a freed slot goes to whichever worker 
+ * takes it first, runs only wait in order within their own worker. 
+ * @param max_runs the number of interpreters allowed at once, 0 for no limit. 
+ */
+void runq_init(int max_runs)
+{
+    max_running = max_runs;
+    if(max_runs > 0) {
+        log_message(LOG_INFO, "Running at most %d interpreters at once\r\n", max_runs);
+    }
+    
+    if(max_runs > 0 && worker_slot_fd() >= 0 && loop_add(worker_slot_fd(), 0, _runq_slot_ready, NULL)) {
+        slot_fd = worker_slot_fd();
+    }
+}
+
+/**
+ * Ask for an interpreter slot. When none is free the run is queued and 
+ * its handler is called as it moves up. 
+ * @param e the entry of the run, owned by the caller until it is released. 
+ * @param handler called with the queue position. 
+ * @param data handler data. 
+ * @return true when a slot was taken, false when the run was queued. 
+ */
+bool runq_acquire(struct runq_entry* e, runq_handler handler, void* data)
+{
+    e->handler = handler;
+    e->data = data;
+    
+    // A new run never overtakes the runs that are already waiting
+    if(head == NULL && _runq_take()) {
+        running++;
+        stats.admitted++;
+        return true;
+    }
+    
+    e->queued = true;
+    e->since = loop_now();
+    e->next = NULL;
+    if(tail != NULL) {
+        tail->next = e;
+    } else {
+        head = e;
+    }
+    tail = e;
+    
+    stats.queued++;
+    if(++waiting > stats.peak_waiting) {
+        stats.peak_waiting = waiting;
+    }
+    _runq_watch();
+    return false;
+}
+
+/**
+ * Remove a waiting run from the queue, nothing happens when it isn't queued. 
+ * @param context the websocket context. 
+ * @param e the entry of the run. 
+ */
+void runq_cancel(struct libwebsocket_context* context, struct runq_entry* e)
+{
+    struct runq_entry* prev = NULL;
+    struct runq_entry* c;
+    int position = 1;
+    
+    if(!e->queued) {
+        return;
+    }
+    
+    for(c = head; c != e; prev = c, c = c->next, position++);
+    if(prev != NULL) {
+        prev->next = e->next;
+    } else {
+        head = e->next;
+    }
+    if(tail == e) {
+        tail = prev;
+    }
+    
+    e->queued = false;
+    waiting--;
+    _runq_watch();
+    _runq_notify(context, e->next, position);
+}
+
+/**
+ * Give back a slot once its interpreter is gone and start the next 
+ * waiting run. 
+ * @param context the websocket context. 
+ */
+void runq_release(struct libwebsocket_context* context)
+{
+    if(running > 0) {
+        running--;
+        if(slot_fd >= 0) {
+            worker_slot_give();
+        }
+    }
+    
+    _runq_next(context);
+}
+
+/**
+ * Get the position of a waiting run. 
+ * @param e the entry of the run. 
+ * @return the position, starting at 1, or 0 when the run is not queued. 
+ */
+int runq_position(const struct runq_entry* e)
+{
+    const struct runq_entry* c;
+    int position = 1;
+    
+    if(!e->queued) {
+        return 0;
+    }
+    
+    for(c = head; c != e; c = c->next, position++);
+    return position;
+}
+
+/**
+ * Get the run scheduler counters. 
+ * @param s the structure to fill. 
+ */
+void runq_get_stats(struct runq_stats* s)
+{
+    memcpy(s, &stats, sizeof(struct runq_stats));
+    s->running = running;
+    s->waiting = waiting;
+}
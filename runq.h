@@ -0,0 +1,109 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   runq.h
+ * Created on October 17, 2026, 7:15 PM
+ */
+
+#ifndef RUNQ_H
+#define	RUNQ_H
+
+#include <libwebsockets.h>
+#include <stdbool.h>
+
+/**
+ * Called when a waiting run moves up the queue, position 0 means the 
+ * run got a slot and may start now. 
+ */
+typedef void (*runq_handler)(struct libwebsocket_context* context, void* data, int position);
+
+/**
+ * A run waiting for a free interpreter slot. 
+ */
+struct runq_entry {
+    runq_handler handler;                              /* Called when the position changes */
+    void* data;                                         /* Handler data */
+    long long since;                                    /* When the run was queued, see loop_now() */
+    bool queued;                                        /* True while waiting for a slot */
+    struct runq_entry* next;                           /* Next waiting run */
+};
+
+/**
+ * Run scheduler counters. 
+ */
+struct runq_stats {
+    unsigned long admitted;                             /* Runs that got a slot */
+    unsigned long queued;                               /* Runs that had to wait for a slot */
+    unsigned long long wait_ms;                         /* Total time runs waited */
+    int peak_waiting;                                   /* Longest queue seen */
+    int running;                                        /* Slots in use now */
+    int waiting;                                        /* Runs waiting now */
+};
+
+/**
+ * Start the run scheduler. 
+ * @param max_runs the number of interpreters allowed at once, 0 for no limit. 
+ */
+void runq_init(int max_runs);
+
+/**
+ * Ask for an interpreter slot. When none is free the run is queued and 
+ * its handler is called as it moves up. 
+ * @param e the entry of the run, owned by the caller until it is released. 
+ * @param handler called with the queue position. 
+ * @param data handler data. 
+ * @return true when a slot was taken, false when the run was queued. 
+ */
+bool runq_acquire(struct runq_entry* e, runq_handler handler, void* data);
+
+/**
+ * Remove a waiting run from the queue, nothing happens when it isn't queued. 
+ * @param context the websocket context. 
+ * @param e the entry of the run. 
+ */
+void runq_cancel(struct libwebsocket_context* context, struct runq_entry* e);
+
+/**
+ * Give back a slot once its interpreter is gone and start the next 
+ * waiting run. 
+ * @param context the websocket context. 
+ */
+void runq_release(struct libwebsocket_context* context);
+
+/**
+ * Get the position of a waiting run. 
+ * @param e the entry of the run. 
+ * @return the position, starting at 1, or 0 when the run is not queued. 
+ */
+int runq_position(const struct runq_entry* e);
+
+/**
+ * Get the run scheduler counters. 
+ * @param s the structure to fill. 
+ */
+void runq_get_stats(struct runq_stats* s);
+
+#endif
@@ -0,0 +1,264 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   spill.c
+ * Created on October 17, 2026, 7:40 PM
+ */
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "spill.h"
+#include "ring.h"
+#include "config.h"
+#include "logger.h"
+
+/**
+ * Allocate the memory part of a log, the file is created once it's needed. 
+ * @param s the log. 
+ * @param mem_size the bytes kept in memory. 
+ * @param file_size the older bytes kept in a file, 0 for none. 
+ * @return true on success. 
+ */
+bool spill_init(struct spill* s, size_t mem_size, size_t file_size)
+{
+    // Bytes move to the file a read buffer at a time
+    if(mem_size < DPT_WEB_IDE_PROC_READ_BUFF) {
+        mem_size = DPT_WEB_IDE_PROC_READ_BUFF;
+    }
+    
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    s->file_size = file_size;
+    return ring_init(&s->mem, mem_size);
+}
+
+/**
+ * Free a log and close its file. 
+ * @param s the log. 
+ */
+void spill_free(struct spill* s)
+{
+    ring_free(&s->mem);
+    if(s->fd >= 0) {
+        close(s->fd);
+    }
+    s->fd = -1;
+    s->file_used = 0;
+    s->end = 0;
+    s->mark_count = 0;
+}
+
+/**
+ * Get the offset of the oldest byte still in a log. 
+ * @param s the log. 
+ * @return the offset. 
+ */
+unsigned long long spill_start(const struct spill* s)
+{
+    return s->end - s->mem.used - s->file_used;
+}
+
+/**
+ * Read or write bytes of the overflow file, which wraps around at its 
+ * capacity. 
+ * @param s the log. 
+ * @param offset the log offset of the first byte. 
+ * @param buf the bytes. 
+ * @param len the number of bytes. 
+ * @param write true to write, false to read. 
+ * @return true on success. 
+ */
+static bool _spill_file_io(const struct spill* s, unsigned long long offset, void* buf, size_t len, bool write)
+{
+    unsigned char* p = buf;
+    size_t pos, n;
+    ssize_t done;
+    
+    while(len > 0) {
+        pos = offset % s->file_size;
+        n = s->file_size - pos < len ? s->file_size - pos : len;
+        done = write ? pwrite(s->fd, p, n, pos) : pread(s->fd, p, n, pos);
+        if(done < 0 && errno == EINTR) {
+            continue;
+        }
+        if(done <= 0) {
+            return false;
+        }
+        p += done;
+        offset += done;
+        len -= done;
+    }
+    
+    return true;
+}
+
+/**
+ * Move the oldest bytes in memory to the overflow file, they are dropped 
+ * when the log has no file. 
+ * @param s the log. 
+ * @param data the oldest bytes in memory. 
+ * @param len the number of bytes. 
+ */
+static void _spill_overflow(struct spill* s, unsigned char* data, size_t len)
+{
+    char path[] = DPT_WEB_IDE_SPILL_TMP;
+    
+    if(s->file_size == 0) {
+        return;
+    }
+    
+    if(s->fd < 0) {
+        if((s->fd = mkostemps(path, 4, O_CLOEXEC)) < 0) {
+            log_message(LOG_ERROR, "Could not create output log file: %s\r\n", strerror(errno));
+            s->file_size = 0;
+            return;
+        }
+        unlink(path);
+    }
+    
+    if(!_spill_file_io(s, s->end - s->mem.used, data, len, true)) {
+        log_message(LOG_ERROR, "Could not write output log file: %s\r\n", strerror(errno));
+        close(s->fd);
+        s->fd = -1;
+        s->file_size = 0;
+        s->file_used = 0;
+        return;
+    }
+    
+    s->file_used = s->file_used + len < s->file_size ? s->file_used + len : s->file_size;
+}
+
+/**
+ * Remember where a record starts, at most one mark per part of the log 
+ * so the marks cover all of it. 
+ * @param s the log. 
+ */
+static void _spill_mark(struct spill* s)
+{
+    unsigned long long stride = (s->mem.size + s->file_size) / DPT_WEB_IDE_SPILL_MARKS;
+    
+    if(s->mark_count > 0 && s->end - s->marks[s->mark_count - 1] < stride) {
+        return;
+    }
+    
+    if(s->mark_count == DPT_WEB_IDE_SPILL_MARKS) {
+        memmove(s->marks, s->marks + 1, (DPT_WEB_IDE_SPILL_MARKS - 1) * sizeof(s->marks[0]));
+        s->mark_count--;
+    }
+    s->marks[s->mark_count++] = s->end;
+}
+
+/**
+ * Add a record to a log, the oldest bytes are trimmed when it is full. 
+ * @param s the log. 
+ * @param data the record. 
+ * @param len the length of the record. 
+ */
+void spill_append(struct spill* s, const void* data, size_t len)
+{
+    unsigned char chunk[DPT_WEB_IDE_PROC_READ_BUFF];
+    const unsigned char* p = data;
+    size_t n;
+    
+    _spill_mark(s);
+    
+    while(len > 0) {
+        if(ring_space(&s->mem) == 0) {
+            n = ring_peek(&s->mem, chunk, sizeof(chunk));
+            _spill_overflow(s, chunk, n);
+            ring_consume(&s->mem, n);
+        }
+        
+        n = ring_write(&s->mem, p, len);
+        p += n;
+        len -= n;
+        s->end += n;
+    }
+}
+
+/**
+ * Find where a reader continues. Offsets that were trimmed move up to the 
+ * first record start still in the log, offsets past the end to the end. 
+ * @param s the log. 
+ * @param offset the offset the reader wants. 
+ * @return the offset to read from. 
+ */
+unsigned long long spill_seek(const struct spill* s, unsigned long long offset)
+{
+    unsigned long long start = spill_start(s);
+    int i;
+    
+    if(offset >= s->end) {
+        return s->end;
+    }
+    if(offset >= start) {
+        return offset;
+    }
+    
+    for(i = 0; i < s->mark_count; ++i) {
+        if(s->marks[i] >= start) {
+            return s->marks[i];
+        }
+    }
+    return s->end;
+}
+
+/**
+ * Copy bytes out of a log. 
+ * @param s the log. 
+ * @param offset the offset of the first byte, see spill_seek(). 
+ * @param buf the buffer to copy to. 
+ * @param len the size of the buffer. 
+ * @return the number of bytes copied, 0 at the end or on error. 
+ */
+size_t spill_read(const struct spill* s, unsigned long long offset, void* buf, size_t len)
+{
+    unsigned long long mem_start = s->end - s->mem.used;
+    size_t done = 0;
+    
+    if(offset < spill_start(s) || offset >= s->end) {
+        return 0;
+    }
+    
+    // The older part of the range comes from the file
+    if(offset < mem_start) {
+        done = mem_start - offset < len ? mem_start - offset : len;
+        if(!_spill_file_io(s, offset, buf, done, false)) {
+            log_message(LOG_ERROR, "Could not read output log file: %s\r\n", strerror(errno));
+            return 0;
+        }
+    }
+    
+    return done + ring_peek_at(&s->mem, offset + done - mem_start, (unsigned char*) buf + done, len - done);
+}
@@ -0,0 +1,105 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   spill.h
+ * Created on October 17, 2026, 7:40 PM
+ */
+
+#ifndef SPILL_H
+#define	SPILL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "config.h"
+#include "ring.h"
+
+/**
+ * A bounded append-only log addressed by byte offset. The newest bytes 
+ * stay in memory, older ones move to an unlinked temporary file when the 
+ * log has one and are dropped after that. Every append starts a record, 
+ * a reader that fell behind the trimmed start resumes at a record start. 
+ */
+struct spill {
+    struct ring mem;                                    /* The newest bytes */
+    int fd;                                             /* The overflow file, -1 until it is needed */
+    size_t file_size;                                   /* Capacity of the overflow file, 0 without one */
+    size_t file_used;                                   /* Bytes in the overflow file */
+    unsigned long long end;                             /* Offset after the newest byte */
+    unsigned long long marks[DPT_WEB_IDE_SPILL_MARKS];  /* Offsets of record starts, oldest first */
+    int mark_count;                                     /* Number of record starts remembered */
+};
+
+/**
+ * Allocate the memory part of a log, the file is created once it's needed. 
+ * @param s the log. 
+ * @param mem_size the bytes kept in memory. 
+ * @param file_size the older bytes kept in a file, 0 for none. 
+ * @return true on success. 
+ */
+bool spill_init(struct spill* s, size_t mem_size, size_t file_size);
+
+/**
+ * Free a log and close its file. 
+ * @param s the log. 
+ */
+void spill_free(struct spill* s);
+
+/**
+ * Get the offset of the oldest byte still in a log. 
+ * @param s the log. 
+ * @return the offset. 
+ */
+unsigned long long spill_start(const struct spill* s);
+
+/**
+ * Add a record to a log, the oldest bytes are trimmed when it is full. 
+ * @param s the log. 
+ * @param data the record. 
+ * @param len the length of the record. 
+ */
+void spill_append(struct spill* s, const void* data, size_t len);
+
+/**
+ * Find where a reader continues. Offsets that were trimmed move up to the 
+ * first record start still in the log, offsets past the end to the end. 
+ * @param s the log. 
+ * @param offset the offset the reader wants. 
+ * @return the offset to read from. 
+ */
+unsigned long long spill_seek(const struct spill* s, unsigned long long offset);
+
+/**
+ * Copy bytes out of a log. 
+ * @param s the log. 
+ * @param offset the offset of the first byte, see spill_seek(). 
+ * @param buf the buffer to copy to. 
+ * @param len the size of the buffer. 
+ * @return the number of bytes copied, 0 at the end or on error. 
+ */
+size_t spill_read(const struct spill* s, unsigned long long offset, void* buf, size_t len);
+
+#endif
@@ -0,0 +1,351 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   dpt-pack.c
+ * Created on October 17, 2026, 10:12 AM
+ */
+
+/*
+ * Host tool that packs the IDE's HTML tree into one indexed bundle that
+ * dpt-web-ide-server can map and serve without touching the filesystem. 
+ * 
+ * Usage: dpt-pack <html directory> <output bundle>
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <endian.h>
+#include <sys/stat.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "bundle.h"
+
+#define PACK_PATH_BUFF      1024                        // Buffer size for filesystem paths
+
+/**
+ * A file collected for packing. 
+ */
+struct pack_file {
+    char* path;                                         /* Path relative to the root, starting with '/' */
+    time_t mtime;                                       /* Modification time */
+};
+
+static struct pack_file* files = NULL;                  /* Collected files */
+static size_t file_count = 0;                           /* Number of collected files */
+
+/**
+ * Check if a name ends in a suffix. 
+ * @param name the name to check. 
+ * @param suffix the suffix. 
+ * @return true when the name ends in the suffix. 
+ */
+static bool _pack_has_suffix(const char* name, const char* suffix)
+{
+    size_t n = strlen(name), s = strlen(suffix);
+    
+    return n > s && strcmp(name + n - s, suffix) == 0;
+}
+
+/**
+ * Collect all regular files under a directory. Precompressed siblings 
+ * are not collected, they are stored with their original. 
+ * @param root the HTML root. 
+ * @param rel the directory relative to the root. 
+ * @return true on success. 
+ */
+static bool _pack_collect(const char* root, const char* rel)
+{
+    char path[PACK_PATH_BUFF];
+    char child[PACK_PATH_BUFF];
+    struct pack_file* f;
+    struct dirent* ent;
+    struct stat st;
+    DIR* d;
+    
+    snprintf(path, sizeof(path), "%s%s", root, rel);
+    if((d = opendir(path)) == NULL) {
+        fprintf(stderr, "Could not open directory %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    
+    while((ent = readdir(d)) != NULL) {
+        if(ent->d_name[0] == '.') {
+            continue;
+        }
+        
+        snprintf(child, sizeof(child), "%s/%s", rel, ent->d_name);
+        snprintf(path, sizeof(path), "%s%s", root, child);
+        if(stat(path, &st)) {
+            continue;
+        }
+        
+        if(S_ISDIR(st.st_mode)) {
+            if(!_pack_collect(root, child)) {
+                closedir(d);
+                return false;
+            }
+        } else if(S_ISREG(st.st_mode) && !_pack_has_suffix(child, ".gz") && !_pack_has_suffix(child, ".br")) {
+            if((f = realloc(files, (file_count + 1) * sizeof(struct pack_file))) == NULL) {
+                closedir(d);
+                return false;
+            }
+            files = f;
+            files[file_count].path = strdup(child);
+            files[file_count].mtime = st.st_mtime;
+            file_count++;
+        }
+    }
+    
+    closedir(d);
+    return true;
+}
+
+/**
+ * Sort collected files by path. 
+ */
+static int _pack_compare(const void* a, const void* b)
+{
+    return strcmp(((const struct pack_file*) a)->path, ((const struct pack_file*) b)->path);
+}
+
+/**
+ * Read a complete file. 
+ * @param path the file to read. 
+ * @param size filled with the file size. 
+ * @return the data or NULL when the file can't be read. 
+ */
+static unsigned char* _pack_read(const char* path, size_t* size)
+{
+    unsigned char* data;
+    FILE* f;
+    long n;
+    
+    if((f = fopen(path, "rb")) == NULL) {
+        return NULL;
+    }
+    
+    fseek(f, 0, SEEK_END);
+    n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    
+    if(n < 0 || (data = malloc(n ? n : 1)) == NULL || fread(data, 1, n, f) != (size_t) n) {
+        fclose(f);
+        return NULL;
+    }
+    
+    fclose(f);
+    *size = n;
+    return data;
+}
+
+#ifdef HAVE_ZLIB
+/**
+ * Compress a buffer in the gzip format. 
+ * @param data the data to compress. 
+ * @param size the size of the data. 
+ * @param out_size filled with the compressed size. 
+ * @return the compressed data or NULL when it is not smaller than the original. 
+ */
+static unsigned char* _pack_gzip(const unsigned char* data, size_t size, size_t* out_size)
+{
+    unsigned char* out;
+    z_stream zs;
+    
+    memset(&zs, 0, sizeof(zs));
+    if(size == 0 || deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+    
+    if((out = malloc(size)) == NULL) {
+        deflateEnd(&zs);
+        return NULL;
+    }
+    
+    zs.next_in = (unsigned char*) data;
+    zs.avail_in = size;
+    zs.next_out = out;
+    zs.avail_out = size;
+    
+    if(deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+        deflateEnd(&zs);
+        free(out);
+        return NULL;
+    }
+    
+    *out_size = zs.total_out;
+    deflateEnd(&zs);
+    return out;
+}
+#endif
+
+/**
+ * Append data to the bundle and describe it in a blob. 
+ * @param out the bundle being written. 
+ * @param blob the blob to fill. 
+ * @param data the data to append. 
+ * @param size the size of the data. 
+ * @return true on success. 
+ */
+static bool _pack_write_blob(FILE* out, struct bundle_blob* blob, const unsigned char* data, size_t size)
+{
+    uint64_t h = 14695981039346656037ULL;
+    long offset = ftell(out);
+    size_t i;
+    
+    if(offset < 0 || (uint64_t) offset + size > UINT32_MAX || fwrite(data, 1, size, out) != size) {
+        return false;
+    }
+    
+    /* Content hash, the entity tag is the same for identical content */
+    for(i = 0; i < size; ++i) {
+        h ^= data[i];
+        h *= 1099511628211ULL;
+    }
+    
+    blob->offset = htole32((uint32_t) offset);
+    blob->size = htole32((uint32_t) size);
+    snprintf(blob->etag, BUNDLE_ETAG_LEN, "\"%016llx\"", (unsigned long long) h);
+    return true;
+}
+
+/**
+ * Pack an HTML tree into a bundle. 
+ * @param argc argument count. 
+ * @param argv argument data. 
+ * @return 0 on success. 
+ */
+int main(int argc, char** argv)
+{
+    static const char* const suffixes[BUNDLE_BLOB_COUNT] = { "", ".gz", ".br" };
+    char path[PACK_PATH_BUFF];
+    struct bundle_header hdr;
+    struct bundle_record* records;
+    unsigned char* data;
+    unsigned char* original = NULL;
+    size_t size;
+#ifdef HAVE_ZLIB
+    size_t original_size = 0;
+#endif
+    long offset;
+    size_t i;
+    int k;
+    FILE* out;
+    
+    if(argc != 3) {
+        fprintf(stderr, "Usage: %s <html directory> <output bundle>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    
+    if(!_pack_collect(argv[1], "")) {
+        return EXIT_FAILURE;
+    }
+    qsort(files, file_count, sizeof(struct pack_file), _pack_compare);
+    
+    if((records = calloc(file_count ? file_count : 1, sizeof(struct bundle_record))) == NULL || 
+       (out = fopen(argv[2], "wb")) == NULL) {
+        fprintf(stderr, "Could not create %s: %s\n", argv[2], strerror(errno));
+        return EXIT_FAILURE;
+    }
+    
+    /* The header is rewritten once the index offset is known */
+    memset(&hdr, 0, sizeof(hdr));
+    fwrite(&hdr, sizeof(hdr), 1, out);
+    
+    for(i = 0; i < file_count; ++i) {
+        offset = ftell(out);
+        records[i].path_offset = htole32((uint32_t) offset);
+        records[i].path_length = htole32((uint32_t) strlen(files[i].path));
+        records[i].mtime = htole64((uint64_t) files[i].mtime);
+        fwrite(files[i].path, 1, strlen(files[i].path), out);
+        
+        for(k = 0; k < BUNDLE_BLOB_COUNT; ++k) {
+            snprintf(path, sizeof(path), "%s%s%s", argv[1], files[i].path, suffixes[k]);
+            data = _pack_read(path, &size);
+#ifdef HAVE_ZLIB
+            /* No precompressed sibling, compress it ourselves */
+            if(data == NULL && k == BUNDLE_BLOB_GZIP && original != NULL) {
+                data = _pack_gzip(original, original_size, &size);
+            }
+#endif
+            if(data == NULL) {
+                if(k == BUNDLE_BLOB_IDENTITY) {
+                    fprintf(stderr, "Could not read %s\n", path);
+                    return EXIT_FAILURE;
+                }
+                continue;
+            }
+            
+            if(!_pack_write_blob(out, &records[i].blobs[k], data, size)) {
+                fprintf(stderr, "Could not write %s to the bundle\n", path);
+                return EXIT_FAILURE;
+            }
+            
+            if(k == BUNDLE_BLOB_IDENTITY) {
+                original = data;
+#ifdef HAVE_ZLIB
+                original_size = size;
+#endif
+            } else {
+                free(data);
+            }
+        }
+        
+        free(original);
+        original = NULL;
+    }
+    
+    /* The index goes last, 8 byte aligned */
+    while(ftell(out) % 8) {
+        fputc(0, out);
+    }
+    offset = ftell(out);
+    if(fwrite(records, sizeof(struct bundle_record), file_count, out) != file_count) {
+        fprintf(stderr, "Could not write the bundle index\n");
+        return EXIT_FAILURE;
+    }
+    
+    memcpy(hdr.magic, BUNDLE_MAGIC, sizeof(hdr.magic));
+    hdr.count = htole32((uint32_t) file_count);
+    hdr.index_offset = htole32((uint32_t) offset);
+    fseek(out, 0, SEEK_SET);
+    fwrite(&hdr, sizeof(hdr), 1, out);
+    
+    if(fclose(out)) {
+        fprintf(stderr, "Could not write %s: %s\n", argv[2], strerror(errno));
+        return EXIT_FAILURE;
+    }
+    
+    printf("Packed %d files into %s\n", (int) file_count, argv[2]);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,295 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   upload.c
+ * Created on October 17, 2026, 10:12 AM
+ */
+
+#define _GNU_SOURCE
+
+#include <libwebsockets.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <libgen.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "upload.h"
+#include "offload.h"
+#include "config.h"
+#include "logger.h"
+
+/**
+ * A file upload being streamed to disk. 
+ */
+struct upload {
+    int fd;                                             /* The temporary file */
+    char tmp_path[DPT_WEB_IDE_HTTP_PATH_BUFF];          /* Path of the temporary file */
+    char path[DPT_WEB_IDE_HTTP_PATH_BUFF];              /* Path of the target file */
+    size_t written;                                     /* Bytes received so far */
+    size_t limit;                                       /* Maximum body size */
+    struct timespec start;                              /* When the upload started */
+    struct offload_job job;                             /* Stores the upload on an I/O thread */
+    bool finishing;                                     /* The upload is being stored */
+    int error;                                          /* Why storing failed, 0 on success */
+    upload_handler done;                                /* Called once the upload is stored */
+    void* data;                                         /* Handler data */
+};
+
+static struct upload_stats stats;                       /* Upload counters */
+
+/**
+ * Check that an upload target stays inside the project directory. 
+ * @param uri the target path. 
+ * @return true when the path is a plain relative file path. 
+ */
+static bool _upload_path_valid(const char* uri)
+{
+    const char* seg = uri;
+    size_t len;
+    
+    if(uri[0] != '/') {
+        return false;
+    }
+    
+    /* Every segment must be a real name, no '', '.' or '..' */
+    while(*seg == '/') {
+        seg++;
+        len = strcspn(seg, "/");
+        if(len == 0 || (len == 1 && seg[0] == '.') || (len == 2 && seg[0] == '.' && seg[1] == '.')) {
+            return false;
+        }
+        seg += len;
+    }
+    
+    return *seg == '\0';
+}
+
+/**
+ * Close the temporary file and count a failed upload. 
+ * @param up the upload. 
+ */
+static void _upload_discard(struct upload* up)
+{
+    close(up->fd);
+    unlink(up->tmp_path);
+    stats.failed++;
+    free(up);
+}
+
+/**
+ * Start an upload into a temporary file next to the target. 
+ * @param root the project directory. 
+ * @param uri the target path relative to the project directory. 
+ * @param expected the announced body size. 
+ * @param limit the maximum body size. 
+ * @param status filled with the HTTP status code on failure. 
+ * @return the upload or NULL on failure. 
+ */
+struct upload* upload_begin(const char* root, const char* uri, size_t expected, size_t limit, unsigned int* status)
+{
+    struct upload* up;
+    char dir[DPT_WEB_IDE_HTTP_PATH_BUFF];
+    
+    if(!_upload_path_valid(uri)) {
+        log_message(LOG_WARNING, "Rejected upload to invalid path %s\r\n", uri);
+        stats.failed++;
+        *status = HTTP_STATUS_FORBIDDEN;
+        return NULL;
+    }
+    
+    if(expected > limit) {
+        log_message(LOG_WARNING, "Rejected upload of %lu bytes to %s, limit is %lu\r\n", (unsigned long) expected, uri, (unsigned long) limit);
+        stats.failed++;
+        *status = HTTP_STATUS_REQ_ENTITY_TOO_LARGE;
+        return NULL;
+    }
+    
+    if((up = calloc(1, sizeof(struct upload))) == NULL) {
+        stats.failed++;
+        *status = HTTP_STATUS_INTERNAL_SERVER_ERROR;
+        return NULL;
+    }
+    
+    /* The temporary file lives next to the target so rename() is atomic */
+    if(snprintf(up->path, sizeof(up->path), "%s%s", root, uri) >= (int) sizeof(up->path)) {
+        free(up);
+        stats.failed++;
+        *status = HTTP_STATUS_FORBIDDEN;
+        return NULL;
+    }
+    strcpy(dir, up->path);
+    if(snprintf(up->tmp_path, sizeof(up->tmp_path), "%s/.upload-XXXXXX", dirname(dir)) >= (int) sizeof(up->tmp_path) || 
+       (up->fd = mkostemp(up->tmp_path, O_CLOEXEC)) < 0) {
+        log_message(LOG_ERROR, "Could not create upload file for %s: %s\r\n", up->path, strerror(errno));
+        free(up);
+        stats.failed++;
+        *status = HTTP_STATUS_NOT_FOUND;
+        return NULL;
+    }
+    
+    /* mkostemp() creates private files, stored projects are plain files */
+    fchmod(up->fd, 0644);
+    up->limit = limit;
+    clock_gettime(CLOCK_MONOTONIC, &up->start);
+    return up;
+}
+
+/**
+ * Append a chunk of the body to the upload. 
+ * @param up the upload. 
+ * @param data the chunk. 
+ * @param len the length of the chunk. 
+ * @param status filled with the HTTP status code on failure. 
+ * @return true on success, the upload must be aborted on failure. 
+ */
+bool upload_write(struct upload* up, const void* data, size_t len, unsigned int* status)
+{
+    const char* p = data;
+    ssize_t n;
+    
+    if(up->written + len > up->limit) {
+        log_message(LOG_WARNING, "Upload to %s exceeds the limit of %lu bytes\r\n", up->path, (unsigned long) up->limit);
+        *status = HTTP_STATUS_REQ_ENTITY_TOO_LARGE;
+        return false;
+    }
+    
+    while(len > 0) {
+        n = write(up->fd, p, len);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n < 0) {
+            log_message(LOG_ERROR, "Could not write upload %s: %s\r\n", up->tmp_path, strerror(errno));
+            *status = HTTP_STATUS_INTERNAL_SERVER_ERROR;
+            return false;
+        }
+        p += n;
+        len -= n;
+        up->written += n;
+    }
+    
+    return true;
+}
+
+/**
+ * Flush an upload to disk and replace its target, runs on an I/O thread. 
+ * @param data the upload. 
+ */
+static void _upload_store(void* data)
+{
+    struct upload* up = (struct upload*) data;
+    char dir[DPT_WEB_IDE_HTTP_PATH_BUFF];
+    int dfd;
+    
+    if(fsync(up->fd) || rename(up->tmp_path, up->path)) {
+        up->error = errno;
+        return;
+    }
+    
+    /* Make the rename itself durable */
+    strcpy(dir, up->path);
+    if((dfd = open(dirname(dir), O_RDONLY | O_DIRECTORY | O_CLOEXEC)) >= 0) {
+        fsync(dfd);
+        close(dfd);
+    }
+    up->error = 0;
+}
+
+/**
+ * Completion of a stored upload, runs on the event loop. 
+ * @param context the websocket context. 
+ * @param data the upload. 
+ */
+static void _upload_stored(struct libwebsocket_context* context, void* data)
+{
+    struct upload* up = (struct upload*) data;
+    upload_handler done = up->done;
+    void* done_data = up->data;
+    bool stored = up->error == 0;
+    struct timespec end;
+    
+    if(!stored) {
+        log_message(LOG_ERROR, "Could not store upload %s: %s\r\n", up->path, strerror(up->error));
+        _upload_discard(up);
+    } else {
+        close(up->fd);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        stats.completed++;
+        stats.bytes += up->written;
+        stats.seconds += (end.tv_sec - up->start.tv_sec) + (end.tv_nsec - up->start.tv_nsec) / 1e9;
+        log_message(LOG_INFO, "Stored upload %s (%lu bytes)\r\n", up->path, (unsigned long) up->written);
+        free(up);
+    }
+    
+    if(done != NULL) {
+        done(context, stored, done_data);
+    }
+}
+
+/**
+ * Flush the upload to disk and atomically replace the target on an I/O 
+ * thread. Frees the upload once it is stored. 
+ * @param up the upload. 
+ * @param done called once the upload is stored or failed to. 
+ * @param data handler data. 
+ */
+void upload_finish(struct upload* up, upload_handler done, void* data)
+{
+    up->finishing = true;
+    up->done = done;
+    up->data = data;
+    offload_submit(&up->job, _upload_store, _upload_stored, up);
+}
+
+/**
+ * Throw away an unfinished upload. Frees the upload. An upload that is 
+ * being stored is still stored, only its handler isn't called anymore. 
+ * @param up the upload. 
+ */
+void upload_abort(struct upload* up)
+{
+    if(up != NULL && up->finishing) {
+        up->done = NULL;
+    } else if(up != NULL) {
+        _upload_discard(up);
+    }
+}
+
+/**
+ * Get the upload counters. 
+ * @param s the structure to fill. 
+ */
+void upload_get_stats(struct upload_stats* s)
+{
+    *s = stats;
+}
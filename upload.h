@@ -0,0 +1,105 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   upload.h
+ * Created on October 17, 2026, 10:12 AM
+ */
+
+#ifndef UPLOAD_H
+#define	UPLOAD_H
+
+#include <libwebsockets.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * A file upload being streamed to disk. 
+ */
+struct upload;
+
+/**
+ * Upload counters. 
+ */
+struct upload_stats {
+    unsigned long completed;                            /* Uploads stored on disk */
+    unsigned long failed;                               /* Uploads rejected or aborted */
+    unsigned long long bytes;                           /* Bytes written by completed uploads */
+    double seconds;                                     /* Time spent receiving completed uploads */
+};
+
+/**
+ * Start an upload into a temporary file next to the target. 
+ * @param root the project directory. 
+ * @param uri the target path relative to the project directory. 
+ * @param expected the announced body size. 
+ * @param limit the maximum body size. 
+ * @param status filled with the HTTP status code on failure. 
+ * @return the upload or NULL on failure. 
+ */
+struct upload* upload_begin(const char* root, const char* uri, size_t expected, size_t limit, unsigned int* status);
+
+/**
+ * Append a chunk of the body to the upload. 
+ * @param up the upload. 
+ * @param data the chunk. 
+ * @param len the length of the chunk. 
+ * @param status filled with the HTTP status code on failure. 
+ * @return true on success, the upload must be aborted on failure. 
+ */
+bool upload_write(struct upload* up, const void* data, size_t len, unsigned int* status);
+
+/**
+ * Called on the event loop once an upload is stored. 
+ * @param context the websocket context, NULL during shutdown. 
+ * @param stored true when the target was replaced. 
+ * @param data the handler data. 
+ */
+typedef void (*upload_handler)(struct libwebsocket_context* context, bool stored, void* data);
+
+/**
+ * Flush the upload to disk and atomically replace the target on an I/O 
+ * thread. Frees the upload once it is stored. 
+ * @param up the upload. 
+ * @param done called once the upload is stored or failed to. 
+ * @param data handler data. 
+ */
+void upload_finish(struct upload* up, upload_handler done, void* data);
+
+/**
+ * Throw away an unfinished upload. Frees the upload. An upload that is 
+ * being stored is still stored, only its handler isn't called anymore. 
+ * @param up the upload. 
+ */
+void upload_abort(struct upload* up);
+
+/**
+ * Get the upload counters. 
+ * @param s the structure to fill. 
+ */
+void upload_get_stats(struct upload_stats* s);
+
+#endif
+
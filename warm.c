@@ -0,0 +1,316 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   warm.c
+ * Created on October 17, 2026, 10:12 AM
+ */
+
+#define _GNU_SOURCE
+
+#include <libwebsockets.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include "warm.h"
+#include "loop.h"
+#include "process.h"
+#include "config.h"
+#include "logger.h"
+
+static struct warm_process* idle = NULL;                /* Idle interpreters, oldest first */
+static int idle_count = 0;                              /* Number of idle interpreters */
+static int pool_size = 0;                               /* Number of idle interpreters to keep */
+static int ttl_ms = 0;                                  /* Lifetime of an idle interpreter */
+static struct loop_timer refill_timer;                  /* Starts missing interpreters */
+static struct loop_timer ttl_timer;                     /* Replaces the oldest interpreter */
+static struct warm_stats stats;                         /* Pool counters */
+
+static void _warm_refill(struct libwebsocket_context* context, void* data);
+static void _warm_expire(struct libwebsocket_context* context, void* data);
+
+/**
+ * Arm the TTL timer for the oldest idle interpreter. 
+ */
+static void _warm_schedule_expiry(void)
+{
+    long long wait;
+    
+    if(idle_count == 0) {
+        loop_timer_stop(&ttl_timer);
+        return;
+    }
+    
+    wait = idle[0].born + ttl_ms - loop_now();
+    loop_timer_start(&ttl_timer, wait > 0 ? (int) wait : 0, _warm_expire, NULL);
+}
+
+/**
+ * Take an interpreter out of the idle list. 
+ * @param i the position in the idle list. 
+ * @param p filled with the interpreter. 
+ */
+static void _warm_take(int i, struct warm_process* p)
+{
+    *p = idle[i];
+    loop_remove(p->proc.out);
+    memmove(&idle[i], &idle[i + 1], (idle_count - i - 1) * sizeof(struct warm_process));
+    idle_count--;
+    _warm_schedule_expiry();
+}
+
+/**
+ * Stop an interpreter that never got a script. 
+ * @param p the interpreter. 
+ */
+static void _warm_kill(struct warm_process* p)
+{
+    close(p->script_fd);
+    close(p->stdin_fd);
+    process_stop(&p->proc);
+}
+
+/**
+ * Event loop handler for an idle interpreter that closed its output, 
+ * it exited or crashed before it got a script. 
+ * @param context the websocket context. 
+ * @param fd the stdout pipe. 
+ * @param revents the poll events that occurred. 
+ * @param data unused. 
+ */
+static void _warm_died(struct libwebsocket_context* context, int fd, short revents, void* data)
+{
+    struct warm_process p;
+    int i;
+    
+    for(i = 0; i < idle_count && idle[i].proc.out != fd; ++i);
+    if(i == idle_count) {
+        loop_remove(fd);
+        return;
+    }
+    
+    log_message(LOG_WARNING, "Idle interpreter %d exited, retrying in %d ms\r\n", (int) idle[i].proc.pid, DPT_WEB_IDE_WARM_RETRY);
+    _warm_take(i, &p);
+    _warm_kill(&p);
+    stats.died++;
+    
+    /* Back off so a broken interpreter doesn't respawn in a tight loop */
+    loop_timer_start(&refill_timer, DPT_WEB_IDE_WARM_RETRY, _warm_refill, NULL);
+}
+
+/**
+ * Start one idle interpreter waiting for its script on a pipe. The pipe 
+ * is not its stdin, so stdin stays free for the program. 
+ * @return true on success. 
+ */
+static bool _warm_spawn(void)
+{
+    struct warm_process* p = &idle[idle_count];
+    char fd_path[32];
+    const char* argv[] = { DPT_WEB_IDE_INTERPRETER_CMD, fd_path, NULL };
+    struct process_options opts;
+    struct process_fd_map map[2];
+    struct timespec t0, t1;
+    int script_fd[2];
+    int stdin_fd[2];
+    bool ok;
+    
+    if(pipe2(script_fd, O_CLOEXEC)) {
+        log_message(LOG_ERROR, "Could not create interpreter script pipe\r\n");
+        return false;
+    }
+    if(pipe2(stdin_fd, O_CLOEXEC)) {
+        log_message(LOG_ERROR, "Could not create interpreter stdin pipe\r\n");
+        close(script_fd[0]);
+        close(script_fd[1]);
+        return false;
+    }
+    
+    snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", DPT_WEB_IDE_SCRIPT_FD);
+    memset(&opts, 0, sizeof(opts));
+    opts.argv = argv;
+    opts.fds = map;
+    opts.fd_count = 2;
+    map[0].fd = script_fd[0];
+    map[0].target = DPT_WEB_IDE_SCRIPT_FD;
+    map[1].fd = stdin_fd[0];
+    map[1].target = 0;
+    if(access(conf->project_path, X_OK) == 0) {
+        opts.cwd = conf->project_path;
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    ok = process_spawn(&opts, &p->proc);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    close(script_fd[0]);
+    close(stdin_fd[0]);
+    
+    if(!ok) {
+        log_message(LOG_ERROR, "Could not start idle interpreter\r\n");
+        close(script_fd[1]);
+        close(stdin_fd[1]);
+        return false;
+    }
+    
+    p->script_fd = script_fd[1];
+    p->stdin_fd = stdin_fd[1];
+    p->born = loop_now();
+    fcntl(p->script_fd, F_SETFL, O_NONBLOCK);
+    fcntl(p->stdin_fd, F_SETFL, O_NONBLOCK);
+    
+    /* Only hangups are reported for a descriptor without events */
+    loop_add(p->proc.out, 0, _warm_died, NULL);
+    
+    stats.spawned++;
+    stats.spawn_us += (t1.tv_sec - t0.tv_sec) * 1000000LL + (t1.tv_nsec - t0.tv_nsec) / 1000;
+    if(++idle_count == 1) {
+        _warm_schedule_expiry();
+    }
+    return true;
+}
+
+/**
+ * Timer handler starting one missing interpreter at a time, so refilling 
+ * never holds up the event loop for long. 
+ * @param context the websocket context. 
+ * @param data unused. 
+ */
+static void _warm_refill(struct libwebsocket_context* context, void* data)
+{
+    if(idle_count >= pool_size) {
+        return;
+    }
+    
+    if(!_warm_spawn()) {
+        loop_timer_start(&refill_timer, DPT_WEB_IDE_WARM_RETRY, _warm_refill, NULL);
+    } else if(idle_count < pool_size) {
+        loop_timer_start(&refill_timer, 0, _warm_refill, NULL);
+    }
+}
+
+/**
+ * Timer handler replacing idle interpreters that outlived their TTL. 
+ * @param context the websocket context. 
+ * @param data unused. 
+ */
+static void _warm_expire(struct libwebsocket_context* context, void* data)
+{
+    struct warm_process p;
+    long long now = loop_now();
+    
+    while(idle_count > 0 && idle[0].born + ttl_ms <= now) {
+        _warm_take(0, &p);
+        _warm_kill(&p);
+        stats.recycled++;
+    }
+    
+    if(!refill_timer.armed) {
+        loop_timer_start(&refill_timer, 0, _warm_refill, NULL);
+    }
+}
+
+/**
+ * Start the interpreter pool. 
+ * @param size the number of idle interpreters to keep, 0 disables the pool. 
+ * @param ttl the time in seconds after which an idle interpreter is replaced. 
+ * @return true on success. 
+ */
+bool warm_init(int size, int ttl)
+{
+    if(size <= 0) {
+        return true;
+    }
+    
+    if((idle = calloc(size, sizeof(struct warm_process))) == NULL) {
+        log_message(LOG_ERROR, "Could not allocate the interpreter pool\r\n");
+        return false;
+    }
+    
+    pool_size = size;
+    ttl_ms = ttl * 1000;
+    loop_timer_start(&refill_timer, 0, _warm_refill, NULL);
+    log_message(LOG_INFO, "Keeping %d idle interpreters for %d s\r\n", size, ttl);
+    return true;
+}
+
+/**
+ * Stop all idle interpreters and free the pool. 
+ */
+void warm_free(void)
+{
+    struct warm_process p;
+    
+    loop_timer_stop(&refill_timer);
+    while(idle_count > 0) {
+        _warm_take(0, &p);
+        _warm_kill(&p);
+    }
+    loop_timer_stop(&ttl_timer);
+    
+    free(idle);
+    idle = NULL;
+    pool_size = 0;
+}
+
+/**
+ * Take an idle interpreter from the pool, a replacement is started in 
+ * the background. The caller owns the process afterwards. 
+ * @param p filled with the interpreter. 
+ * @return true when an interpreter was available. 
+ */
+bool warm_claim(struct warm_process* p)
+{
+    if(pool_size == 0) {
+        return false;
+    }
+    
+    if(!refill_timer.armed) {
+        loop_timer_start(&refill_timer, 0, _warm_refill, NULL);
+    }
+    
+    if(idle_count == 0) {
+        stats.misses++;
+        return false;
+    }
+    
+    _warm_take(0, p);
+    stats.hits++;
+    return true;
+}
+
+/**
+ * Get the interpreter pool counters. 
+ * @param s the structure to fill. 
+ */
+void warm_get_stats(struct warm_stats* s)
+{
+    *s = stats;
+}
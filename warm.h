@@ -0,0 +1,88 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   warm.h
+ * Created on October 17, 2026, 10:12 AM
+ */
+
+#ifndef WARM_H
+#define	WARM_H
+
+#include <stdbool.h>
+
+#include "process.h"
+
+/**
+ * An idle interpreter waiting for a script on a pipe. 
+ */
+struct warm_process {
+    struct process proc;                                /* The interpreter and its output pipes */
+    int script_fd;                                      /* Write end of the script pipe, non blocking */
+    int stdin_fd;                                       /* Write end of the interpreter's stdin, non blocking */
+    long long born;                                     /* When it was started, see loop_now() */
+};
+
+/**
+ * Interpreter pool counters. 
+ */
+struct warm_stats {
+    unsigned long hits;                                 /* Runs served by an idle interpreter */
+    unsigned long misses;                               /* Runs that had to start an interpreter */
+    unsigned long spawned;                              /* Interpreters started for the pool */
+    unsigned long recycled;                             /* Idle interpreters stopped after their TTL */
+    unsigned long died;                                 /* Idle interpreters that exited by themselves */
+    unsigned long long spawn_us;                        /* Total time spent starting pool interpreters */
+};
+
+/**
+ * Start the interpreter pool. 
+ * @param size the number of idle interpreters to keep, 0 disables the pool. 
+ * @param ttl the time in seconds after which an idle interpreter is replaced. 
+ * @return true on success. 
+ */
+bool warm_init(int size, int ttl);
+
+/**
+ * Stop all idle interpreters and free the pool. 
+ */
+void warm_free(void);
+
+/**
+ * Take an idle interpreter from the pool, a replacement is started in 
+ * the background. The caller owns the process afterwards. 
+ * @param p filled with the interpreter. 
+ * @return true when an interpreter was available. 
+ */
+bool warm_claim(struct warm_process* p);
+
+/**
+ * Get the interpreter pool counters. 
+ * @param s the structure to fill. 
+ */
+void warm_get_stats(struct warm_stats* s);
+
+#endif
+
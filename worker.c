@@ -0,0 +1,333 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   worker.c
+ * Created on October 17, 2026, 8:15 PM
+ */
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "worker.h"
+#include "logger.h"
+
+static pid_t* pids = NULL;                              /* Worker processes by index, -1 when not running */
+static time_t* started = NULL;                          /* When each worker was last started */
+static int worker_count = 1;                            /* Number of workers */
+static int worker_index = 0;                            /* Index of this worker */
+static volatile sig_atomic_t stopping = 0;              /* The workers were asked to stop */
+static int slot_fds[2] = {-1, -1};                      /* Pipe holding one byte per free interpreter slot */
+static int* held = NULL;                                /* Slots taken by each worker, shared with the supervisor */
+
+/**
+ * Create the pipe the workers take interpreter slots from. 
+ * @param count the number of workers. 
+ * @param slots the number of slots. 
+ * @return true on success. 
+ */
+static bool _worker_slots_init(int count, int slots)
+{
+    char tokens[256];
+    ssize_t n;
+    
+    if(pipe2(slot_fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+        log_message(LOG_ERROR, "Could not create the interpreter slot pipe: %s\r\n", strerror(errno));
+        return false;
+    }
+    
+    held = mmap(NULL, count * sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(held == MAP_FAILED) {
+        log_message(LOG_ERROR, "Could not share the interpreter slots: %s\r\n", strerror(errno));
+        held = NULL;
+        return false;
+    }
+    
+    memset(tokens, 0, sizeof(tokens));
+    while(slots > 0) {
+        if((n = write(slot_fds[1], tokens, slots < (int) sizeof(tokens) ? (size_t) slots : sizeof(tokens))) < 0) {
+            log_message(LOG_ERROR, "Could not fill the interpreter slot pipe: %s\r\n", strerror(errno));
+            return false;
+        }
+        slots -= n;
+    }
+    return true;
+}
+
+/**
+ * Close the interpreter slot pipe. 
+ * @param count the number of workers. 
+ */
+static void _worker_slots_free(int count)
+{
+    if(slot_fds[0] >= 0) {
+        close(slot_fds[0]);
+        close(slot_fds[1]);
+    }
+    if(held != NULL) {
+        munmap(held, count * sizeof(int));
+    }
+    slot_fds[0] = -1;
+    slot_fds[1] = -1;
+    held = NULL;
+}
+
+/**
+ * Give back the slots a worker held when it died, the cap would 
+ * otherwise shrink with every crash. Interpreters that outlive their 
+ * worker are no longer counted. 
+ * @param index the index of the worker. 
+ */
+static void _worker_slots_reclaim(int index)
+{
+    if(held == NULL || held[index] == 0) {
+        return;
+    }
+    
+    log_message(LOG_WARNING, "Giving back %d interpreter slots of worker %d\r\n", held[index], index);
+    for(; held[index] > 0; held[index]--) {
+        if(write(slot_fds[1], "", 1) != 1) {
+            log_message(LOG_ERROR, "Could not give back an interpreter slot: %s\r\n", strerror(errno));
+            break;
+        }
+    }
+    held[index] = 0;
+}
+
+/**
+ * Start one worker process. 
+ * @param index the index of the worker. 
+ * @return 0 in the worker, its pid in the supervisor or -1 on error. 
+ */
+static pid_t _worker_fork(int index)
+{
+    pid_t parent = getpid();
+    pid_t pid;
+    
+    // Buffered log lines would otherwise be written by both processes
+    fflush(stdout);
+    fflush(stderr);
+    
+    if((pid = fork()) < 0) {
+        log_message(LOG_ERROR, "Could not start worker %d: %s\r\n", index, strerror(errno));
+        return -1;
+    }
+    
+    if(pid == 0) {
+        // A worker stops with its supervisor, also when that one is killed
+        prctl(PR_SET_PDEATHSIG, SIGINT);
+        if(getppid() != parent) {
+            _exit(EXIT_FAILURE);
+        }
+        free(pids);
+        free(started);
+        pids = NULL;
+        started = NULL;
+        worker_index = index;
+        return 0;
+    }
+    
+    pids[index] = pid;
+    started[index] = time(NULL);
+    log_message(LOG_INFO, "Started worker %d with pid %d\r\n", index, (int) pid);
+    
+    // The stop request may have come before the worker was known
+    if(stopping) {
+        kill(pid, SIGINT);
+    }
+    return pid;
+}
+
+/**
+ * Fork worker processes that serve connections from the listen socket 
+ * of the websocket context, which must exist already. The calling process 
+ * becomes their supervisor, it restarts workers that die and returns once 
+ * all of them stopped after worker_stop(). 
+ * @param count the number of workers. 
+ * @param slots the number of interpreter slots the workers share, see 
+ *        worker_slot_take(), 0 for no limit. 
+ * @return the index of the worker in a worker process, -1 in the 
+ *         supervisor. 
+ */
+int worker_start(int count, int slots)
+{
+    int alive = 0;
+    int status;
+    pid_t pid;
+    int i;
+    
+    pids = malloc(count * sizeof(pid_t));
+    started = malloc(count * sizeof(time_t));
+    if(pids == NULL || started == NULL) {
+        log_message(LOG_ERROR, "Could not allocate memory for %d workers, serving from one process\r\n", count);
+        free(pids);
+        free(started);
+        pids = NULL;
+        started = NULL;
+        return 0;
+    }
+    
+    // Workers that each counted their own slots would need a static split of the cap
+    if(slots > 0 && !_worker_slots_init(count, slots)) {
+        log_message(LOG_ERROR, "Serving from one process\r\n");
+        _worker_slots_free(count);
+        free(pids);
+        free(started);
+        pids = NULL;
+        started = NULL;
+        return 0;
+    }
+    
+    worker_count = count;
+    for(i = 0; i < count; ++i) {
+        pids[i] = -1;
+    }
+    
+    for(i = 0; i < count && !stopping; ++i) {
+        if((pid = _worker_fork(i)) == 0) {
+            return i;
+        }
+        alive += pid > 0;
+    }
+    
+    while(alive > 0) {
+        if((pid = waitpid(-1, &status, 0)) < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            log_message(LOG_ERROR, "Could not wait for the workers: %s\r\n", strerror(errno));
+            break;
+        }
+        
+        for(i = 0; i < count && pids[i] != pid; ++i);
+        if(i == count) {
+            continue;
+        }
+        pids[i] = -1;
+        alive--;
+        
+        if(stopping) {
+            continue;
+        }
+        _worker_slots_reclaim(i);
+        
+        // A worker that keeps dying right away is restarted at most once a second
+        log_message(LOG_WARNING, "Worker %d (pid %d) ended unexpectedly with status %d, restarting it\r\n", i, (int) pid, status);
+        if(time(NULL) - started[i] < 1) {
+            sleep(1);
+        }
+        if((pid = _worker_fork(i)) == 0) {
+            return i;
+        }
+        alive += pid > 0;
+    }
+    
+    log_message(LOG_INFO, "All workers stopped\r\n");
+    _worker_slots_free(count);
+    free(pids);
+    free(started);
+    pids = NULL;
+    started = NULL;
+    return -1;
+}
+
+/**
+ * Ask all workers to stop, safe to call from a signal handler. Does 
+ * nothing in a worker. 
+ */
+void worker_stop(void)
+{
+    pid_t* p = pids;
+    int i;
+    
+    stopping = 1;
+    for(i = 0; p != NULL && i < worker_count; ++i) {
+        if(p[i] > 0) {
+            kill(p[i], SIGINT);
+        }
+    }
+}
+
+/**
+ * Get the part of a limit that applies to this worker. The limit is 
+ * divided over all workers so the shares add up to the limit, workers 
+ * beyond a small limit get 0. 
+ * @param total the limit for the whole server, 0 stays 0. 
+ * @return the limit of this worker. 
+ */
+int worker_share(int total)
+{
+    return total / worker_count + (worker_index < total % worker_count);
+}
+
+/**
+ * Get the file descriptor that becomes readable when an interpreter slot 
+ * is free. 
+ * @return the file descriptor, -1 when the workers don't share slots. 
+ */
+int worker_slot_fd(void)
+{
+    return held != NULL ? slot_fds[0] : -1;
+}
+
+/**
+ * Take one of the interpreter slots shared by all workers. 
+ * @return true when a slot was taken, false when none is free. 
+ */
+bool worker_slot_take(void)
+{
+    char token;
+    
+    if(read(slot_fds[0], &token, 1) != 1) {
+        return false;
+    }
+    held[worker_index]++;
+    return true;
+}
+
+/**
+ * Give back an interpreter slot taken with worker_slot_take(). 
+ */
+void worker_slot_give(void)
+{
+    if(write(slot_fds[1], "", 1) != 1) {
+        log_message(LOG_ERROR, "Could not give back an interpreter slot: %s\r\n", strerror(errno));
+        return;
+    }
+    held[worker_index]--;
+}
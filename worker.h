@@ -0,0 +1,82 @@
+/* 
+ * Copyright (c) 2014, Daan Pape
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     1. Redistributions of source code must retain the above copyright 
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     2. Redistributions in binary form must reproduce the above copyright 
+ *        notice, this list of conditions and the following disclaimer in the 
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * File:   worker.h
+ * Created on October 17, 2026, 8:15 PM
+ */
+
+#ifndef WORKER_H
+#define	WORKER_H
+
+#include <stdbool.h>
+
+/**
+ * Fork worker processes that serve connections from the listen socket 
+ * of the websocket context, which must exist already. The calling process 
+ * becomes their supervisor, it restarts workers that die and returns once 
+ * all of them stopped after worker_stop(). 
+ * @param count the number of workers. 
+ * @param slots the number of interpreter slots the workers share, see 
+ *        worker_slot_take(), 0 for no limit. 
+ * @return the index of the worker in a worker process, -1 in the 
+ *         supervisor. 
+ */
+int worker_start(int count, int slots);
+
+/**
+ * Ask all workers to stop, safe to call from a signal handler. Does 
+ * nothing in a worker. 
+ */
+void worker_stop(void);
+
+/**
+ * Get the part of a limit that applies to this worker. The limit is 
+ * divided over all workers so the shares add up to the limit, workers 
+ * beyond a small limit get 0. 
+ * @param total the limit for the whole server, 0 stays 0. 
+ * @return the limit of this worker. 
+ */
+int worker_share(int total);
+
+/**
+ * Get the file descriptor that becomes readable when an interpreter slot 
+ * is free. 
+ * @return the file descriptor, -1 when the workers don't share slots. 
+ */
+int worker_slot_fd(void);
+
+/**
+ * Take one of the interpreter slots shared by all workers. 
+ * @return true when a slot was taken, false when none is free. 
+ */
+bool worker_slot_take(void);
+
+/**
+ * Give back an interpreter slot taken with worker_slot_take(). 
+ */
+void worker_slot_give(void);
+
+#endif